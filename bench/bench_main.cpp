@@ -0,0 +1,5 @@
+#include <benchmark/benchmark.h>
+
+// Run with --benchmark_out=<file> --benchmark_out_format=json to keep results
+// for comparison between commits (see the aaqt_bench_json target)
+BENCHMARK_MAIN();
@@ -0,0 +1,199 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <boost/asio.hpp>
+
+#include <aasdk/Messenger/Cryptor.hpp>
+#include <aasdk/Messenger/FrameHeader.hpp>
+#include <aasdk/Messenger/FrameSize.hpp>
+#include <aasdk/Messenger/MessageInStream.hpp>
+#include <aasdk/IO/Promise.hpp>
+
+#include "cachingsslwrapper.h"
+#include "pipelinedmessageinstream.h"
+#include "replaytransport.h"
+#include "tlspeer.h"
+
+// Framing and decryption of recorded session traffic. The traffic is recorded
+// in-process: a TlsPeer plays the phone, completes a real handshake with the
+// head unit's Cryptor and then encrypts video-sized payloads into AAP frames.
+
+namespace {
+
+// Frames recorded per refill of the replay transport
+const int cFramesPerRefill = 256;
+
+class RecordedSession
+{
+public:
+    explicit RecordedSession(bool encrypted)
+        : m_encrypted(encrypted),
+          m_sslWrapper(std::make_shared<CachingSSLWrapper>()),
+          m_cryptor(std::make_shared<aasdk::messenger::Cryptor>(m_sslWrapper)),
+          m_transport(std::make_shared<ReplayTransport>())
+    {
+        m_cryptor->init();
+        if (encrypted) {
+            m_peer.init();
+            handshake();
+        }
+    }
+
+    ~RecordedSession()
+    {
+        m_cryptor->deinit();
+    }
+
+    // Records one BULK video frame per call
+    void record(size_t payloadSize)
+    {
+        m_payload.assign(payloadSize, 0x42);
+
+        aasdk::common::Data body;
+        if (m_encrypted) {
+            m_peer.encrypt(m_payload.data(), m_payload.size(), body);
+        } else {
+            body = m_payload;
+        }
+
+        const auto encryption = m_encrypted ? aasdk::messenger::EncryptionType::ENCRYPTED
+                                            : aasdk::messenger::EncryptionType::PLAIN;
+        aasdk::messenger::FrameHeader header(aasdk::messenger::ChannelId::VIDEO, aasdk::messenger::FrameType::BULK,
+                                             encryption, aasdk::messenger::MessageType::SPECIFIC);
+        aasdk::messenger::FrameSize size(body.size());
+
+        aasdk::common::Data frame = header.getData();
+        const aasdk::common::Data sizeData = size.getData();
+        frame.insert(frame.end(), sizeData.begin(), sizeData.end());
+        frame.insert(frame.end(), body.begin(), body.end());
+        m_transport->append(frame);
+    }
+
+    void refill(size_t payloadSize)
+    {
+        for (int i = 0; i < cFramesPerRefill; ++i) {
+            record(payloadSize);
+        }
+    }
+
+    aasdk::messenger::ICryptor::Pointer cryptor() const
+    {
+        return m_cryptor;
+    }
+
+    std::shared_ptr<ReplayTransport> transport() const
+    {
+        return m_transport;
+    }
+
+private:
+    void handshake()
+    {
+        for (int round = 0; round < 16; ++round) {
+            const bool clientDone = m_cryptor->doHandshake();
+            const aasdk::common::Data clientBytes = m_cryptor->readHandshakeBuffer();
+            m_peer.handshake(clientBytes.data(), clientBytes.size());
+
+            const std::vector<uint8_t> serverBytes = m_peer.takeOutput();
+            if (!serverBytes.empty()) {
+                m_cryptor->writeHandshakeBuffer(aasdk::common::DataConstBuffer(serverBytes));
+            }
+
+            if (clientDone && m_peer.isEstablished()) {
+                return;
+            }
+        }
+        throw std::runtime_error("TLS handshake with the recorded peer did not complete");
+    }
+
+    bool m_encrypted;
+    std::shared_ptr<CachingSSLWrapper> m_sslWrapper;
+    std::shared_ptr<aasdk::messenger::Cryptor> m_cryptor;
+    std::shared_ptr<ReplayTransport> m_transport;
+    TlsPeer m_peer;
+    std::vector<uint8_t> m_payload;
+};
+
+std::shared_ptr<aasdk::messenger::IMessageInStream> makeStream(boost::asio::io_service &ioService,
+                                                               const RecordedSession &session, bool pipelined)
+{
+    if (pipelined) {
+        return std::make_shared<PipelinedMessageInStream>(ioService, session.transport(), session.cryptor());
+    }
+    return std::make_shared<aasdk::messenger::MessageInStream>(ioService, session.transport(), session.cryptor());
+}
+
+void receiveMessages(benchmark::State &state, bool encrypted, bool pipelined)
+{
+    const size_t payloadSize = static_cast<size_t>(state.range(0));
+
+    boost::asio::io_service ioService;
+    boost::asio::io_service::work work(ioService);
+    RecordedSession session(encrypted);
+    session.refill(payloadSize);
+
+    auto stream = makeStream(ioService, session, pipelined);
+
+    for (auto _ : state) {
+        // Refill outside the measurement; the pipelined stream reads ahead
+        // of the frame being timed, so keep a margin
+        if (session.transport()->buffered() < payloadSize * 32) {
+            state.PauseTiming();
+            session.refill(payloadSize);
+            state.ResumeTiming();
+        }
+
+        bool done = false;
+        auto promise = aasdk::io::PromisePtr<aasdk::messenger::Message::Pointer>(
+            new aasdk::io::Promise<aasdk::messenger::Message::Pointer>(
+                [&done](aasdk::messenger::Message::Pointer message) {
+                    benchmark::DoNotOptimize(message->getPayload().data());
+                    done = true;
+                },
+                [&done, &state](const aasdk::error::Error &e) {
+                    state.SkipWithError(e.what());
+                    done = true;
+                }
+            )
+        );
+
+        stream->startReceive(promise);
+        while (!done) {
+            ioService.run_one();
+        }
+    }
+
+    if (pipelined) {
+        std::static_pointer_cast<PipelinedMessageInStream>(stream)->stop();
+        ioService.poll();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * payloadSize);
+}
+
+void BM_ReceivePlain_Inline(benchmark::State &state)
+{
+    receiveMessages(state, false, false);
+}
+
+void BM_ReceivePlain_Pipelined(benchmark::State &state)
+{
+    receiveMessages(state, false, true);
+}
+
+void BM_ReceiveEncrypted_Inline(benchmark::State &state)
+{
+    receiveMessages(state, true, false);
+}
+
+void BM_ReceiveEncrypted_Pipelined(benchmark::State &state)
+{
+    receiveMessages(state, true, true);
+}
+
+}
+
+// 1 KiB control-sized messages up to full 16 KiB video records
+BENCHMARK(BM_ReceivePlain_Inline)->Arg(1024)->Arg(16 * 1024)->UseRealTime();
+BENCHMARK(BM_ReceivePlain_Pipelined)->Arg(1024)->Arg(16 * 1024)->UseRealTime();
+BENCHMARK(BM_ReceiveEncrypted_Inline)->Arg(1024)->Arg(16 * 1024)->UseRealTime();
+BENCHMARK(BM_ReceiveEncrypted_Pipelined)->Arg(1024)->Arg(16 * 1024)->UseRealTime();
@@ -0,0 +1,145 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include <aasdk/Messenger/ChannelId.hpp>
+#include <aasdk_proto/ServiceDiscoveryResponseMessage.pb.h>
+#include <aasdk_proto/AudioFocusRequestMessage.pb.h>
+#include <aasdk_proto/PingRequestMessage.pb.h>
+#include <aasdk_proto/PingResponseMessage.pb.h>
+#include <aasdk_proto/ControlMessageIdsEnum.pb.h>
+
+#include "servicechannel.h"
+
+// Protobuf (de)serialization of the control messages exchanged per session
+
+namespace {
+
+aasdk::proto::messages::ServiceDiscoveryResponse makeServiceDiscoveryResponse()
+{
+    // Same shape as the response AndroidAuto sends
+    aasdk::proto::messages::ServiceDiscoveryResponse response;
+
+    auto video = response.add_channel_descriptors();
+    video->set_channel_id(static_cast<uint32_t>(aasdk::messenger::ChannelId::VIDEO));
+    auto avChannel = video->mutable_av_channel();
+    avChannel->set_stream_type(aasdk::proto::enums::AVStreamType::VIDEO);
+    avChannel->set_available_while_in_call(true);
+    auto videoConfig = avChannel->add_video_configs();
+    videoConfig->set_video_resolution(aasdk::proto::enums::VideoResolution::_1080p);
+    videoConfig->set_video_fps(aasdk::proto::enums::VideoFPS::_60);
+    videoConfig->set_margin_width(0);
+    videoConfig->set_margin_height(0);
+    videoConfig->set_dpi(160);
+
+    for (auto channelId : {aasdk::messenger::ChannelId::SENSOR, aasdk::messenger::ChannelId::AV_INPUT,
+                           aasdk::messenger::ChannelId::INPUT, aasdk::messenger::ChannelId::NAVIGATION}) {
+        response.add_channel_descriptors()->set_channel_id(static_cast<uint32_t>(channelId));
+    }
+
+    return response;
+}
+
+void BM_ServiceDiscoveryResponse_Serialize(benchmark::State &state)
+{
+    const auto response = makeServiceDiscoveryResponse();
+    std::string buffer;
+
+    for (auto _ : state) {
+        response.SerializeToString(&buffer);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+}
+
+void BM_ServiceDiscoveryResponse_Parse(benchmark::State &state)
+{
+    const std::string buffer = makeServiceDiscoveryResponse().SerializeAsString();
+    aasdk::proto::messages::ServiceDiscoveryResponse response;
+
+    for (auto _ : state) {
+        response.ParseFromString(buffer);
+        benchmark::DoNotOptimize(response.channel_descriptors_size());
+    }
+}
+
+void BM_PingRoundTrip(benchmark::State &state)
+{
+    aasdk::proto::messages::PingRequest request;
+    request.set_timestamp(123456789);
+    aasdk::proto::messages::PingRequest parsedRequest;
+    aasdk::proto::messages::PingResponse response;
+    std::string buffer;
+
+    for (auto _ : state) {
+        request.SerializeToString(&buffer);
+        parsedRequest.ParseFromString(buffer);
+        response.set_timestamp(parsedRequest.timestamp());
+        response.SerializeToString(&buffer);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+}
+
+void BM_AudioFocusRequest_Parse(benchmark::State &state)
+{
+    aasdk::proto::messages::AudioFocusRequest request;
+    request.set_audio_focus_type(aasdk::proto::enums::AudioFocusType::GAIN_TRANSIENT);
+    const std::string buffer = request.SerializeAsString();
+    aasdk::proto::messages::AudioFocusRequest parsed;
+
+    for (auto _ : state) {
+        parsed.ParseFromString(buffer);
+        benchmark::DoNotOptimize(parsed.audio_focus_type());
+    }
+}
+
+// Stand-in for a service: enough handlers that the ping is not the first match
+struct DispatchTarget
+{
+    aasdk::messenger::ChannelId channelId() const
+    {
+        return aasdk::messenger::ChannelId::CONTROL;
+    }
+
+    void onRaw(const aasdk::common::DataConstBuffer &buffer)
+    {
+        received += buffer.size;
+    }
+
+    void onPing(const aasdk::proto::messages::PingRequest &request)
+    {
+        received += static_cast<size_t>(request.timestamp());
+    }
+
+    typedef HandlerList<
+        On<DispatchTarget, aasdk::proto::ids::ControlMessage::VERSION_RESPONSE,
+           aasdk::common::DataConstBuffer, &DispatchTarget::onRaw>,
+        On<DispatchTarget, aasdk::proto::ids::ControlMessage::SSL_HANDSHAKE,
+           aasdk::common::DataConstBuffer, &DispatchTarget::onRaw>,
+        On<DispatchTarget, aasdk::proto::ids::ControlMessage::PING_REQUEST,
+           aasdk::proto::messages::PingRequest, &DispatchTarget::onPing>
+    > Handlers;
+
+    size_t received = 0;
+};
+
+// Typed dispatch from message id to handler, including the payload parse
+void BM_TypedDispatch_Ping(benchmark::State &state)
+{
+    aasdk::proto::messages::PingRequest request;
+    request.set_timestamp(1);
+    const std::string buffer = request.SerializeAsString();
+    const aasdk::common::DataConstBuffer body(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+    DispatchTarget target;
+
+    for (auto _ : state) {
+        Dispatch<DispatchTarget, DispatchTarget::Handlers>::run(target, aasdk::proto::ids::ControlMessage::PING_REQUEST, body);
+    }
+    benchmark::DoNotOptimize(target.received);
+}
+
+}
+
+BENCHMARK(BM_ServiceDiscoveryResponse_Serialize);
+BENCHMARK(BM_ServiceDiscoveryResponse_Parse);
+BENCHMARK(BM_PingRoundTrip);
+BENCHMARK(BM_AudioFocusRequest_Parse);
+BENCHMARK(BM_TypedDispatch_Ping);
@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "usbdetector.h"
+
+// Hotplug filtering as done in the libusb callback for every arrival
+
+namespace {
+
+std::vector<libusb_device_descriptor> makeDescriptors()
+{
+    // A typical cabin bus: hubs, a few peripherals and phones
+    std::vector<libusb_device_descriptor> descriptors;
+    const struct {
+        uint8_t deviceClass;
+        uint16_t vendorId;
+        uint16_t productId;
+    } devices[] = {
+        {LIBUSB_CLASS_HUB, 0x1d6b, 0x0002},
+        {LIBUSB_CLASS_HUB, 0x05e3, 0x0610},
+        {LIBUSB_CLASS_PER_INTERFACE, 0x18d1, 0x4ee7},
+        {LIBUSB_CLASS_PER_INTERFACE, 0x18d1, 0x2d00},
+        {LIBUSB_CLASS_PER_INTERFACE, 0x04e8, 0x6860},
+        {LIBUSB_CLASS_PER_INTERFACE, 0x0bda, 0x8153},
+        {LIBUSB_CLASS_MASS_STORAGE, 0x0781, 0x5581},
+        {LIBUSB_CLASS_VENDOR_SPEC, 0x1a86, 0x7523},
+    };
+
+    for (const auto &device : devices) {
+        libusb_device_descriptor desc = {};
+        desc.bDeviceClass = device.deviceClass;
+        desc.idVendor = device.vendorId;
+        desc.idProduct = device.productId;
+        descriptors.push_back(desc);
+    }
+    return descriptors;
+}
+
+void BM_HotplugFilter(benchmark::State &state)
+{
+    const auto descriptors = makeDescriptors();
+
+    for (auto _ : state) {
+        for (const auto &desc : descriptors) {
+            benchmark::DoNotOptimize(UsbDetectionThread::isCandidateDevice(desc));
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * descriptors.size());
+}
+
+void BM_HotplugFilterAndDeviceId(benchmark::State &state)
+{
+    const auto descriptors = makeDescriptors();
+
+    for (auto _ : state) {
+        for (const auto &desc : descriptors) {
+            if (UsbDetectionThread::isCandidateDevice(desc)) {
+                QString deviceId = UsbDetectionThread::deviceId(desc);
+                benchmark::DoNotOptimize(deviceId.constData());
+            }
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * descriptors.size());
+}
+
+}
+
+BENCHMARK(BM_HotplugFilter);
+BENCHMARK(BM_HotplugFilterAndDeviceId);
@@ -0,0 +1,156 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <vector>
+
+#include "videodecoder.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Decodes a raw H.264 clip with every requested thread configuration and
+// reports the sustained frame rate of each one.
+
+namespace {
+
+struct AccessUnit
+{
+    std::vector<uint8_t> data;
+    qint64 timestamp;
+};
+
+std::vector<AccessUnit> splitAccessUnits(const QByteArray &clip)
+{
+    std::vector<AccessUnit> units;
+
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    AVCodecParserContext *parser = av_parser_init(AV_CODEC_ID_H264);
+    AVCodecContext *context = avcodec_alloc_context3(codec);
+    if (parser == nullptr || context == nullptr) {
+        return units;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(clip.constData());
+    int remaining = clip.size();
+    qint64 timestamp = 0;
+
+    // A final zero-length call flushes the parser's last access unit
+    while (true) {
+        uint8_t *out = nullptr;
+        int outSize = 0;
+        const int used = av_parser_parse2(parser, context, &out, &outSize, data, remaining,
+                                          AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        data += used;
+        remaining -= used;
+
+        if (outSize > 0) {
+            units.push_back({std::vector<uint8_t>(out, out + outSize), timestamp});
+            timestamp += 16667;
+        }
+
+        if (remaining <= 0 && outSize == 0) {
+            break;
+        }
+    }
+
+    av_parser_close(parser);
+    avcodec_free_context(&context);
+    return units;
+}
+
+QList<int> parseIntList(const QString &value)
+{
+    QList<int> result;
+    for (const QString &item : value.split(',', Qt::SkipEmptyParts)) {
+        result.append(item.trimmed().toInt());
+    }
+    return result;
+}
+
+VideoDecoder::ThreadMode parseMode(const QString &mode)
+{
+    if (mode == "frame") {
+        return VideoDecoder::ThreadMode::Frame;
+    }
+    if (mode == "slice") {
+        return VideoDecoder::ThreadMode::Slice;
+    }
+    return VideoDecoder::ThreadMode::FrameAndSlice;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("aaqt_decode_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Decodes an H.264 clip with each thread configuration and reports fps");
+    parser.addHelpOption();
+    parser.addPositionalArgument("clip", "Raw Annex-B H.264 stream", "[clip]");
+    parser.addOption({"threads", "Comma separated thread counts, 0 selects the automatic mode", "list", "1,2,3,4,0"});
+    parser.addOption({"modes", "Comma separated thread modes (frame, slice, frame+slice)", "list", "frame,slice,frame+slice"});
+    parser.addOption({"cpus", "Comma separated cores to pin the decoder to", "list"});
+    parser.addOption({"reorder", "Reorder buffer depth", "frames", "2"});
+    parser.addOption({"rgb", "Convert to RGB32 800x480 as the surface would"});
+    parser.process(app);
+
+    const QString clipPath = parser.positionalArguments().value(0, QStringLiteral(AAQT_BENCH_CLIP));
+    QFile file(clipPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical("Unable to open clip %s", qPrintable(clipPath));
+        return 1;
+    }
+
+    const std::vector<AccessUnit> units = splitAccessUnits(file.readAll());
+    if (units.empty()) {
+        qCritical("No access units found in %s", qPrintable(clipPath));
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "clip: " << clipPath << " (" << units.size() << " access units)\n";
+    out << qSetFieldWidth(14) << Qt::left << "mode" << "threads" << "frames" << "dropped" << "fps" << "ms/frame"
+        << qSetFieldWidth(0) << "\n";
+
+    for (const QString &mode : parser.value("modes").split(',', Qt::SkipEmptyParts)) {
+        for (int threads : parseIntList(parser.value("threads"))) {
+            VideoDecoder::Config config;
+            config.threadCount = threads;
+            config.threadMode = parseMode(mode);
+            config.cpus = parseIntList(parser.value("cpus"));
+            config.reorderDepth = parser.value("reorder").toInt();
+            // Nothing may be dropped for backpressure while measuring throughput
+            config.queueDepth = static_cast<int>(units.size()) + 1;
+
+            VideoDecoder decoder(config);
+            if (parser.isSet("rgb")) {
+                decoder.setOutputFormat(QSize(800, 480), QVideoFrame::Format_RGB32);
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            for (const AccessUnit &unit : units) {
+                decoder.submit(unit.data.data(), unit.data.size(), unit.timestamp);
+            }
+            decoder.flush();
+            const qint64 elapsedNs = timer.nsecsElapsed();
+
+            const double frames = static_cast<double>(decoder.decodedFrames());
+            const double fps = frames * 1e9 / elapsedNs;
+            // threadCountChanged is emitted on the decode thread; the atomic getter is safe to read here
+            const QString label = threads == 0 ? QString("auto(%1)").arg(decoder.threadCount()) : QString::number(threads);
+
+            out << qSetFieldWidth(14) << Qt::left << mode << label << decoder.decodedFrames() << decoder.droppedFrames()
+                << QString::number(fps, 'f', 1) << QString::number(frames > 0 ? elapsedNs / frames / 1e6 : 0.0, 'f', 2)
+                << qSetFieldWidth(0) << "\n";
+            out.flush();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef REPLAYTRANSPORT_H
+#define REPLAYTRANSPORT_H
+
+#include <deque>
+#include <utility>
+
+#include <aasdk/Transport/ITransport.hpp>
+#include <aasdk/IO/Promise.hpp>
+#include <aasdk/Error/Error.hpp>
+
+// Transport that serves previously recorded bytes to a message in-stream.
+// Reads that cannot be satisfied yet stay pending until more data is appended.
+class ReplayTransport : public aasdk::transport::ITransport
+{
+public:
+    void append(const aasdk::common::Data &data)
+    {
+        m_buffer.insert(m_buffer.end(), data.begin(), data.end());
+        servePending();
+    }
+
+    size_t buffered() const
+    {
+        return m_buffer.size();
+    }
+
+    void start(aasdk::io::PromisePtr<void> promise) override
+    {
+        promise->resolve();
+    }
+
+    void stop(aasdk::io::PromisePtr<void> promise) override
+    {
+        if (m_pendingPromise != nullptr) {
+            auto pending = std::move(m_pendingPromise);
+            m_pendingPromise.reset();
+            pending->reject(aasdk::error::Error(aasdk::error::ErrorCode::OPERATION_ABORTED));
+        }
+        promise->resolve();
+    }
+
+    void receive(size_t size, aasdk::io::PromisePtr<aasdk::common::Data> promise) override
+    {
+        m_pendingSize = size;
+        m_pendingPromise = std::move(promise);
+        servePending();
+    }
+
+    void send(aasdk::common::Data data, aasdk::io::PromisePtr<void> promise) override
+    {
+        promise->resolve();
+    }
+
+private:
+    void servePending()
+    {
+        if (m_pendingPromise == nullptr || m_buffer.size() < m_pendingSize) {
+            return;
+        }
+
+        aasdk::common::Data data(m_buffer.begin(), m_buffer.begin() + m_pendingSize);
+        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_pendingSize);
+
+        auto promise = std::move(m_pendingPromise);
+        m_pendingPromise.reset();
+        promise->resolve(std::move(data));
+    }
+
+    std::deque<uint8_t> m_buffer;
+    size_t m_pendingSize = 0;
+    aasdk::io::PromisePtr<aasdk::common::Data> m_pendingPromise;
+};
+
+#endif // REPLAYTRANSPORT_H
@@ -1,33 +1,86 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QCommandLineParser>
+#include <QSettings>
+#include <QQuickWindow>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include "src/flightrecorder.h"
+#include "src/startuptimeline.h"
 #include "src/usbdetector.h"
 #include "src/androidauto.h"
+#include "src/navigationstate.h"
+#include "src/threadpolicy.h"
 
 int main(int argc, char *argv[])
 {
+    // A phone can be served once USB is watched, the TLS warm-up is done and the UI is up
+    StartupTimeline startup(QStringList() << "usb-ready" << "warmed-up" << "qml-loaded");
+    
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 #endif
     QGuiApplication app(argc, argv);
+    
+    // Runtime configuration is read through QSettings (~/.config/aa-qt/AndroidAutoQt.conf)
+    QCoreApplication::setOrganizationName("aa-qt");
+    QCoreApplication::setApplicationName("AndroidAutoQt");
+    
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption loopbackOption("loopback", "Connect to a phone emulator instead of waiting for USB.", "host:port");
+    parser.addOption(loopbackOption);
+    parser.process(app);
+    
+    QSettings settings;
+    const QString loopback = parser.isSet(loopbackOption) ? parser.value(loopbackOption)
+                                                          : settings.value("transport/loopback").toString();
 
-    QQmlApplicationEngine engine;
+    // Created before anything that records and destroyed after it; decode with aaqt_flight_dump
+    FlightRecorder flightRecorder(FlightRecorder::Config::fromSettings(settings));
+    FlightRecorder::watchLoop(FlightStage::Gui, [&app](std::function<void()> probe) {
+        QMetaObject::invokeMethod(&app, std::move(probe), Qt::QueuedConnection);
+    });
+
+    // Every other thread applies its own threads/<name> policy when it starts
+    ThreadPolicy::apply("gui", ThreadPolicy::Policy(), false);
+    QTimer threadReport;
+    const int threadReportS = settings.value("threads/reportIntervalS", 60).toInt();
+    if (threadReportS > 0) {
+        QObject::connect(&threadReport, &QTimer::timeout, &ThreadPolicy::logUsage);
+        threadReport.start(threadReportS * 1000);
+    }
 
-    // Create USB detector
+    // Start USB detection first; libusb set-up and the first bus scan overlap QML loading.
+    // Devices found meanwhile are queued to this thread and delivered once the loop runs.
     UsbDetector usbDetector;
+    QObject::connect(&usbDetector, &UsbDetector::ready, [&startup]() {
+        startup.mark("usb-ready");
+    });
+    usbDetector.startDetection();
     
-    // Create Android Auto interface
-    AndroidAuto androidAuto;
+    // Create Android Auto interface; its TLS and protobuf set-up runs in the background
+    // Owned by a shared_ptr because session callbacks hold shared_from_this()
+    auto androidAuto = std::make_shared<AndroidAuto>();
+    QObject::connect(androidAuto.get(), &AndroidAuto::warmedUp, [&startup]() {
+        startup.mark("warmed-up");
+    });
     
     // Connect USB detection to Android Auto
     QObject::connect(&usbDetector, &UsbDetector::deviceConnected,
-                     &androidAuto, &AndroidAuto::onDeviceConnected);
+                     androidAuto.get(), &AndroidAuto::onDeviceConnected);
     QObject::connect(&usbDetector, &UsbDetector::deviceDisconnected,
-                     &androidAuto, &AndroidAuto::onDeviceDisconnected);
+                     androidAuto.get(), &AndroidAuto::onDeviceDisconnected);
     
+    QQmlApplicationEngine engine;
+
     // Expose our C++ classes to QML
     engine.rootContext()->setContextProperty("usbDetector", &usbDetector);
-    engine.rootContext()->setContextProperty("androidAuto", &androidAuto);
+    engine.rootContext()->setContextProperty("androidAuto", androidAuto.get());
+    engine.rootContext()->setContextProperty("navigation", androidAuto->navigation());
 
     const QUrl url(QStringLiteral("qrc:/qml/main.qml"));
     QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
@@ -36,9 +89,38 @@ int main(int argc, char *argv[])
             QCoreApplication::exit(-1);
     }, Qt::QueuedConnection);
     engine.load(url);
+    startup.mark("qml-loaded");
 
-    // Start USB detection
-    usbDetector.startDetection();
+    // The threaded render loop draws on its own thread; the basic loop uses the GUI thread
+    for (QObject *object : engine.rootObjects()) {
+        if (QQuickWindow *window = qobject_cast<QQuickWindow*>(object)) {
+            QObject::connect(window, &QQuickWindow::sceneGraphInitialized, window, [&app]() {
+                if (QThread::currentThread() != app.thread()) {
+                    ThreadPolicy::apply("render");
+                }
+            }, Qt::DirectConnection);
+            // Only the first frame matters; the handler removes itself rather than run for every frame
+            auto firstFrame = std::make_shared<QMetaObject::Connection>();
+            auto swapped = std::make_shared<std::atomic<bool>>(false);
+            *firstFrame = QObject::connect(window, &QQuickWindow::frameSwapped, window, [&startup, window, firstFrame, swapped]() {
+                if (swapped->exchange(true)) {
+                    return;
+                }
+                startup.mark("first-pixel");
+                // The handle belongs to the GUI thread, so the disconnect happens there
+                QMetaObject::invokeMethod(window, [firstFrame]() {
+                    QObject::disconnect(*firstFrame);
+                }, Qt::QueuedConnection);
+            }, Qt::DirectConnection);
+        }
+    }
+
+    if (!loopback.isEmpty()) {
+        const int separator = loopback.lastIndexOf(':');
+        const QString host = separator > 0 ? loopback.left(separator) : QStringLiteral("127.0.0.1");
+        const quint16 port = static_cast<quint16>(loopback.mid(separator + 1).toUInt());
+        androidAuto->connectLoopback(host, port);
+    }
 
     return app.exec();
 }
@@ -49,7 +49,54 @@ Window {
         source: androidAuto
         visible: androidAuto.connected
     }
-    
+
+    // Next maneuver from the phone; bindings only re-evaluate when a value changes
+    Rectangle {
+        id: navigationBanner
+        anchors.left: parent.left
+        anchors.bottom: parent.bottom
+        anchors.margins: 12
+        width: navigationRow.width + 24
+        height: navigationRow.height + 16
+        radius: 8
+        color: "#CC222222"
+        visible: androidAuto.connected && navigation.active && navigation.maneuver !== ""
+
+        Row {
+            id: navigationRow
+            anchors.centerIn: parent
+            spacing: 12
+
+            Text {
+                text: navigation.distanceText
+                color: "white"
+                font.pixelSize: 20
+                font.bold: true
+            }
+
+            Text {
+                text: {
+                    var maneuver = navigation.maneuver.replace(/-/g, " ");
+                    if (navigation.roundaboutExit > 0)
+                        maneuver += " " + qsTr("exit %1").arg(navigation.roundaboutExit);
+                    else if (navigation.side !== "")
+                        maneuver += " " + navigation.side;
+                    return maneuver;
+                }
+                color: "#4CAF50"
+                font.pixelSize: 20
+            }
+
+            Text {
+                text: navigation.street
+                color: "white"
+                font.pixelSize: 20
+                elide: Text.ElideRight
+                width: Math.min(implicitWidth, 320)
+            }
+        }
+    }
+
     Connections {
         target: usbDetector
         function onDeviceConnected(deviceId) {
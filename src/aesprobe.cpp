@@ -0,0 +1,99 @@
+#include "aesprobe.h"
+#include <QElapsedTimer>
+#include <cstdlib>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace {
+
+// Software AES-GCM on a Cortex-A53 stays well below this, the crypto
+// extensions reach several hundred MB/s
+const double cAcceleratedMegabytesPerSecond = 150.0;
+// Roughly a TLS record as the phone sends them for video
+const int cRecordSize = 16 * 1024;
+const int cProbeRecords = 256;
+
+bool cpuHasAes()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (ecx & bit_AES) != 0;
+#elif defined(__aarch64__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(__arm__)
+    return (getauxval(AT_HWCAP2) & HWCAP2_AES) != 0;
+#else
+    return false;
+#endif
+}
+
+bool capabilityMaskSet()
+{
+    return std::getenv("OPENSSL_ia32cap") != nullptr || std::getenv("OPENSSL_armcap") != nullptr;
+}
+
+double measureGcmThroughput()
+{
+    EVP_CIPHER_CTX *context = EVP_CIPHER_CTX_new();
+    if (context == nullptr) {
+        return 0;
+    }
+
+    const unsigned char key[16] = {};
+    unsigned char iv[12] = {};
+    std::vector<unsigned char> input(cRecordSize, 0x5a);
+    std::vector<unsigned char> output(cRecordSize + 16);
+
+    // Decrypt without checking the tag; only the cipher speed matters here
+    QElapsedTimer timer;
+    timer.start();
+    for (int record = 0; record < cProbeRecords; ++record) {
+        iv[11] = static_cast<unsigned char>(record);
+        int length = 0;
+        EVP_DecryptInit_ex(context, EVP_aes_128_gcm(), nullptr, key, iv);
+        EVP_DecryptUpdate(context, output.data(), &length, input.data(), cRecordSize);
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+
+    EVP_CIPHER_CTX_free(context);
+
+    if (elapsedNs <= 0) {
+        return 0;
+    }
+    return static_cast<double>(cRecordSize) * cProbeRecords / (1024.0 * 1024.0) * 1e9 / elapsedNs;
+}
+
+}
+
+QString AesProbeResult::describe() const
+{
+    return QString("AES instructions %1%2, AES-128-GCM %3 MB/s (%4)")
+            .arg(cpuSupport ? "present" : "missing")
+            .arg(maskedByEnvironment ? " but OpenSSL capability mask is set" : "")
+            .arg(megabytesPerSecond, 0, 'f', 0)
+            .arg(accelerated ? "hardware path" : "software path");
+}
+
+AesProbeResult probeAesAcceleration()
+{
+    AesProbeResult result;
+    result.cpuSupport = cpuHasAes();
+    result.maskedByEnvironment = capabilityMaskSet();
+
+    // First pass warms up caches and OpenSSL's dispatch tables
+    measureGcmThroughput();
+    result.megabytesPerSecond = measureGcmThroughput();
+    result.accelerated = result.cpuSupport && result.megabytesPerSecond >= cAcceleratedMegabytesPerSecond;
+    return result;
+}
@@ -0,0 +1,25 @@
+#ifndef AESPROBE_H
+#define AESPROBE_H
+
+#include <QString>
+
+// Checks whether TLS record decryption runs on the CPU's AES instructions
+// (AES-NI on x86, the ARMv8 crypto extensions on ARM) rather than OpenSSL's
+// table-based fallback.
+struct AesProbeResult
+{
+    // The CPU reports AES instructions
+    bool cpuSupport = false;
+    // OPENSSL_ia32cap / OPENSSL_armcap is set and may hide them from OpenSSL
+    bool maskedByEnvironment = false;
+    // Measured AES-128-GCM decrypt throughput
+    double megabytesPerSecond = 0;
+    // Throughput is in the range only the hardware path reaches
+    bool accelerated = false;
+
+    QString describe() const;
+};
+
+AesProbeResult probeAesAcceleration();
+
+#endif // AESPROBE_H
@@ -1,8 +1,21 @@
 #include "androidauto.h"
+#include "videodecoder.h"
+#include "audiocapture.h"
+#include "controlservice.h"
+#include "navigationstate.h"
+#include "sessionchannels.h"
+#include "cachingsslwrapper.h"
+#include "pipelinedmessageinstream.h"
+#include "aesprobe.h"
+#include "flightrecorder.h"
+#include "threadpolicy.h"
 #include <QDebug>
 #include <QPainter>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QImage>
+#include <QSettings>
+#include <future>
 
 // Include the actual implementations here, after the forward declarations in the header
 #include <libusb.h>
@@ -14,6 +27,7 @@
 #include <aasdk/USB/USBHub.hpp>
 #include <aasdk/USB/AOAPDevice.hpp>
 #include <aasdk/TCP/TCPWrapper.hpp>
+#include <aasdk/TCP/TCPEndpoint.hpp>
 #include <aasdk/Transport/USBTransport.hpp>
 #include <aasdk/Transport/TCPTransport.hpp>
 #include <aasdk/Transport/SSLWrapper.hpp>
@@ -22,39 +36,115 @@
 #include <aasdk/Messenger/MessageOutStream.hpp>
 #include <aasdk/Messenger/Messenger.hpp>
 #include <aasdk/Messenger/ChannelId.hpp>
-#include <aasdk/Channel/Control/ControlServiceChannel.hpp>
-#include <aasdk/Channel/Control/IControlServiceChannelEventHandler.hpp>
 #include <aasdk/IO/Promise.hpp>
-
-// Proto includes - corrected paths
-#include <aasdk_proto/ServiceDiscoveryRequestMessage.pb.h>
-#include <aasdk_proto/ServiceDiscoveryResponseMessage.pb.h>
-#include <aasdk_proto/AudioFocusRequestMessage.pb.h>
-#include <aasdk_proto/AudioFocusResponseMessage.pb.h>
-#include <aasdk_proto/ShutdownRequestMessage.pb.h>
-#include <aasdk_proto/ShutdownResponseMessage.pb.h>
-#include <aasdk_proto/NavigationFocusRequestMessage.pb.h>
-#include <aasdk_proto/NavigationFocusResponseMessage.pb.h>
-#include <aasdk_proto/PingRequestMessage.pb.h>
-#include <aasdk_proto/PingResponseMessage.pb.h>
 #include <aasdk/Error/Error.hpp>
+#include <aasdk_proto/ServiceDiscoveryResponseMessage.pb.h>
+
+namespace {
+
+// Everything the handlers of a torn-down session may still reference. It is
+// released on the io thread once the transport and USB hub have stopped.
+struct RetiredSession
+{
+    std::shared_ptr<ControlService> controlService;
+    std::shared_ptr<SessionChannels> channels;
+    std::shared_ptr<aasdk::messenger::IMessenger> messenger;
+    std::shared_ptr<PipelinedMessageInStream> messageInStream;
+    std::shared_ptr<aasdk::messenger::IMessageOutStream> messageOutStream;
+    std::shared_ptr<aasdk::messenger::ICryptor> cryptor;
+    std::shared_ptr<aasdk::transport::ITransport> transport;
+    std::shared_ptr<aasdk::tcp::ITCPWrapper> tcpWrapper;
+    std::shared_ptr<aasdk::usb::IUSBHub> usbHub;
+    std::shared_ptr<aasdk::usb::IUSBWrapper> usbWrapper;
+    std::shared_ptr<std::promise<void>> idle;
+    int pendingStops = 0;
+};
+
+}
 
 AndroidAuto::AndroidAuto(QObject *parent)
     : QAbstractVideoSurface(parent), 
       m_connected(false),
-      m_strand(m_ioService)
+      m_handshakeMs(0),
+      m_sessionResumed(false),
+      m_firstFramePending(false),
+      m_sessionGeneration(0),
+      m_stalledTeardowns(0),
+      m_strand(m_ioService),
+      m_usbContext(nullptr)
 {
     // Set up a timer for simulation mode as fallback
     connect(&m_simulationTimer, &QTimer::timeout, this, &AndroidAuto::simulateFrame);
     
+    // Decoded frames are emitted from the decode thread and presented here
+    qRegisterMetaType<QVideoFrame>();
+    QSettings settings;
+    m_videoDecoder = new VideoDecoder(VideoDecoder::Config::fromSettings(settings), this);
+    connect(m_videoDecoder, &VideoDecoder::frameDecoded, this, &AndroidAuto::onVideoFrame, Qt::QueuedConnection);
+    m_audioCapture.reset(new AudioCapture(AudioCapture::Config::fromSettings(settings)));
+    m_navigationState = new NavigationState(this);
+    
+    // Load the TLS context, certificate and key once for the whole process
+    m_sslWrapper = std::make_shared<CachingSSLWrapper>();
+    m_sslWrapper->setHandshakeListener([this](std::chrono::microseconds duration, bool resumed) {
+        QMetaObject::invokeMethod(this, [this, duration, resumed]() {
+            m_handshakeMs = duration.count() / 1000.0;
+            m_sessionResumed = resumed;
+            emit handshakeCompleted();
+        }, Qt::QueuedConnection);
+    });
+    
+    m_teardownTimeoutMs = settings.value("session/teardownTimeoutMs", 2000).toInt();
+    
     // Start IO Service
     startIOServiceThread();
+    
+    // Nothing below is needed before a phone shows up, so it stays off the GUI thread
+    m_warmUpThread = std::thread([this]() {
+        warmUp();
+    });
 }
 
 AndroidAuto::~AndroidAuto()
 {
+    if (m_warmUpThread.joinable()) {
+        m_warmUpThread.join();
+    }
     shutdownAndroidAuto();
     stopIOServiceThread();
+    
+    // One libusb context serves every connection for the life of the process
+    if (m_usbContext != nullptr) {
+        libusb_exit(m_usbContext);
+    }
+}
+
+void AndroidAuto::warmUp()
+{
+    ThreadPolicy::apply("warmup");
+    QElapsedTimer timer;
+    timer.start();
+    
+    // Load the TLS context, certificate and key; a session that starts first loads them itself
+    m_sslWrapper->preload();
+    
+    // Builds the protobuf descriptors and pages in the message code used by service discovery
+    aasdk::proto::messages::ServiceDiscoveryResponse response;
+    response.add_channel_descriptors()->set_channel_id(0);
+    response.ParseFromString(response.SerializeAsString());
+    
+    // Record decryption is the hottest path at high video bitrates
+    const AesProbeResult aes = probeAesAcceleration();
+    if (aes.accelerated) {
+        qDebug() << "TLS decrypt:" << aes.describe();
+    } else {
+        qWarning() << "TLS decrypt is not hardware accelerated:" << aes.describe();
+    }
+    
+    qDebug() << "Warm-up finished in" << timer.elapsed() << "ms";
+    QMetaObject::invokeMethod(this, [this]() {
+        emit warmedUp();
+    }, Qt::QueuedConnection);
 }
 
 bool AndroidAuto::isConnected() const
@@ -62,10 +152,36 @@ bool AndroidAuto::isConnected() const
     return m_connected;
 }
 
+double AndroidAuto::handshakeMs() const
+{
+    return m_handshakeMs;
+}
+
+bool AndroidAuto::sessionResumed() const
+{
+    return m_sessionResumed;
+}
+
+NavigationState *AndroidAuto::navigation() const
+{
+    return m_navigationState;
+}
+
+quint64 AndroidAuto::stalledTeardowns() const
+{
+    return m_stalledTeardowns;
+}
+
+boost::asio::io_service &AndroidAuto::ioService()
+{
+    return m_ioService;
+}
+
 QList<QVideoFrame::PixelFormat> AndroidAuto::supportedPixelFormats(QAbstractVideoBuffer::HandleType type) const
 {
     if (type == QAbstractVideoBuffer::NoHandle) {
-        return {QVideoFrame::Format_RGB32, QVideoFrame::Format_ARGB32, QVideoFrame::Format_ARGB32_Premultiplied};
+        return {QVideoFrame::Format_RGB32, QVideoFrame::Format_ARGB32, QVideoFrame::Format_ARGB32_Premultiplied,
+                QVideoFrame::Format_YUV420P};
     }
     return {};
 }
@@ -81,6 +197,7 @@ bool AndroidAuto::start(const QVideoSurfaceFormat &format)
     }
     
     m_format = format;
+    m_videoDecoder->setOutputFormat(format.frameSize(), format.pixelFormat());
     return QAbstractVideoSurface::start(format);
 }
 
@@ -101,12 +218,14 @@ void AndroidAuto::stop()
 void AndroidAuto::onDeviceConnected(const QString &deviceId)
 {
     qDebug() << "Android Auto: Device connected:" << deviceId;
+    FlightRecorder::record(FlightEvent::UsbAttached, 0, 0, 0, deviceId.toUtf8().constData());
     initializeAndroidAuto(deviceId);
 }
 
 void AndroidAuto::onDeviceDisconnected(const QString &deviceId)
 {
     qDebug() << "Android Auto: Device disconnected:" << deviceId;
+    FlightRecorder::record(FlightEvent::UsbDetached, 0, 0, 0, deviceId.toUtf8().constData());
     shutdownAndroidAuto();
 }
 
@@ -134,17 +253,41 @@ void AndroidAuto::simulateFrame()
     present(frame);
 }
 
+void AndroidAuto::onVideoFrame(const QVideoFrame &frame)
+{
+    // Real frames replace the placeholder as soon as the phone starts streaming
+    if (m_simulationTimer.isActive()) {
+        m_simulationTimer.stop();
+    }
+    
+    present(frame);
+    FlightRecorder::record(FlightEvent::FramePresented, 0, static_cast<uint64_t>(frame.startTime()));
+    
+    if (m_firstFramePending) {
+        m_firstFramePending = false;
+        emit firstFramePresented();
+    }
+}
+
 void AndroidAuto::startIOServiceThread()
 {
     m_workLoopKeepAlive = std::make_shared<boost::asio::io_service::work>(m_ioService);
     m_ioServiceThread = std::thread([this]() {
         qDebug() << "Starting IO Service thread";
+        ThreadPolicy::apply("io");
         m_ioService.run();
     });
+    
+    // A handler blocking the io thread shows up as an io stall in the flight recorder
+    FlightRecorder::watchLoop(FlightStage::Io, [this](std::function<void()> probe) {
+        m_ioService.post(std::move(probe));
+    });
 }
 
 void AndroidAuto::stopIOServiceThread()
 {
+    FlightRecorder::watchLoop(FlightStage::Io, nullptr);
+    
     if (m_workLoopKeepAlive != nullptr) {
         m_workLoopKeepAlive.reset();
     }
@@ -161,14 +304,17 @@ void AndroidAuto::initializeAndroidAuto(const QString &deviceId)
     QMutexLocker locker(&m_mutex);
     
     // Shutdown any existing connection
-    shutdownAndroidAuto();
+    stopSession(true);
+    const quint64 generation = m_sessionGeneration;
     
     try {
         // Initialize USB components with required context
-        libusb_context* usbContext;
-        libusb_init(&usbContext);
+        if (m_usbContext == nullptr && libusb_init(&m_usbContext) != 0) {
+            m_usbContext = nullptr;
+            throw std::runtime_error("libusb_init failed");
+        }
         
-        m_usbWrapper = std::make_shared<aasdk::usb::USBWrapper>(usbContext);
+        m_usbWrapper = std::make_shared<aasdk::usb::USBWrapper>(m_usbContext);
         auto queryFactory = std::make_shared<aasdk::usb::AccessoryModeQueryFactory>(*m_usbWrapper, m_ioService);
         auto queryChainFactory = std::make_shared<aasdk::usb::AccessoryModeQueryChainFactory>(*m_usbWrapper, m_ioService, *queryFactory);
         
@@ -184,7 +330,7 @@ void AndroidAuto::initializeAndroidAuto(const QString &deviceId)
         auto promise = aasdk::io::PromisePtr<std::shared_ptr<libusb_device_handle>>(
             new aasdk::io::Promise<std::shared_ptr<libusb_device_handle>>(
                 std::bind(&AndroidAuto::onEnumerateResult, this, std::placeholders::_1),
-                std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
+                std::bind(&AndroidAuto::onChannelError, this, generation, std::placeholders::_1)
             )
         );
         
@@ -194,7 +340,7 @@ void AndroidAuto::initializeAndroidAuto(const QString &deviceId)
         auto hubPromise = aasdk::io::PromisePtr<std::shared_ptr<libusb_device_handle>>(
             new aasdk::io::Promise<std::shared_ptr<libusb_device_handle>>(
                 std::bind(&AndroidAuto::onUSBHubResult, this, std::placeholders::_1),
-                std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
+                std::bind(&AndroidAuto::onChannelError, this, generation, std::placeholders::_1)
             )
         );
         
@@ -238,306 +384,306 @@ void AndroidAuto::handleUSBDevice(std::shared_ptr<libusb_device_handle> deviceHa
 {
     try {
         qDebug() << "USB device connected, setting up Android Auto";
+        FlightRecorder::record(FlightEvent::UsbAttached, 0, 0, 0, "aoap");
         
         auto aoapDevice = aasdk::usb::AOAPDevice::create(*m_usbWrapper, m_ioService, deviceHandle);
-        auto transport = std::make_shared<aasdk::transport::USBTransport>(m_ioService, aoapDevice);
-        m_transport = transport;
+        std::shared_ptr<aasdk::transport::ITransport> transport =
+            std::make_shared<aasdk::transport::USBTransport>(m_ioService, aoapDevice);
         
-        auto startPromise = aasdk::io::PromisePtr<void>(
-            new aasdk::io::Promise<void>(
-                []() {},
-                std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-            )
-        );
-        
-        transport->start(startPromise);
-        
-        // Set up SSL and cryptography
-        m_sslWrapper = std::make_shared<aasdk::transport::SSLWrapper>();
-        m_cryptor = std::make_shared<aasdk::messenger::Cryptor>(m_sslWrapper);
-        
-        // Set up messenger
-        m_messageInStream = std::make_shared<aasdk::messenger::MessageInStream>(m_ioService, m_transport, m_cryptor);
-        m_messageOutStream = std::make_shared<aasdk::messenger::MessageOutStream>(m_ioService, m_transport, m_cryptor);
-        m_messenger = std::make_shared<aasdk::messenger::Messenger>(m_ioService, m_messageInStream, m_messageOutStream);
-        
-        // Set up control channel
-        m_controlServiceChannel = std::make_shared<aasdk::channel::control::ControlServiceChannel>(m_strand, m_messenger);
-        
-        auto receivePromise = aasdk::io::PromisePtr<void>(
-            new aasdk::io::Promise<void>(
-                []() {},
-                std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-            )
-        );
-        
-        m_controlServiceChannel->receive(this->shared_from_this(), receivePromise);
-        
-        m_connected = true;
-        emit connectedChanged();
-        
-        // Stop simulation
-        m_simulationTimer.stop();
-        
-        qDebug() << "Android Auto device setup complete";
+        // Session setup and teardown are driven from the GUI thread
+        QMetaObject::invokeMethod(this, [this, transport]() {
+            attachTransport(transport);
+        }, Qt::QueuedConnection);
     }
     catch(const std::exception& ex) {
         qDebug() << "Exception during device setup:" << ex.what();
-        emit error(QString("Error during device setup: %1").arg(ex.what()));
+        QMetaObject::invokeMethod(this, [this, message = QString(ex.what())]() {
+            emit error(QString("Error during device setup: %1").arg(message));
+        }, Qt::QueuedConnection);
     }
 }
 
-void AndroidAuto::shutdownAndroidAuto()
+void AndroidAuto::connectLoopback(const QString &host, quint16 port)
 {
-    QMutexLocker locker(&m_mutex);
+    qDebug() << "Connecting to phone emulator at" << host << port;
     
-    // Stop video surface
-    if (isActive()) {
-        stop();
-    }
-    
-    // Stop simulation timer
-    m_simulationTimer.stop();
+    shutdownAndroidAuto();
     
-    try {
-        // Stop control channel
-        if(m_controlServiceChannel != nullptr) {
-            auto stopPromise = aasdk::io::PromisePtr<void>(
-                new aasdk::io::Promise<void>(
-                    []() {},
-                    [](const aasdk::error::Error&) {}
-                )
-            );
-            m_controlServiceChannel->stop(stopPromise);
+    auto tcpWrapper = std::make_shared<aasdk::tcp::TCPWrapper>();
+    m_tcpWrapper = tcpWrapper;
+    auto socket = std::make_shared<boost::asio::ip::tcp::socket>(m_ioService);
+    
+    tcpWrapper->asyncConnect(*socket, host.toStdString(), port,
+                             [this, tcpWrapper, socket, host, port](const boost::system::error_code& ec) {
+        if (ec) {
+            qDebug() << "Loopback connect failed:" << QString::fromStdString(ec.message());
+            QMetaObject::invokeMethod(this, [this, host, port]() {
+                emit error(QString("Unable to reach phone emulator at %1:%2").arg(host).arg(port));
+            }, Qt::QueuedConnection);
+            return;
         }
         
-        // Stop transport
-        if(m_transport != nullptr) {
-            auto stopPromise = aasdk::io::PromisePtr<void>(
-                new aasdk::io::Promise<void>(
-                    []() {},
-                    [](const aasdk::error::Error&) {}
-                )
-            );
-            m_transport->stop(stopPromise);
-        }
+        socket->set_option(boost::asio::ip::tcp::no_delay(true));
+        auto endpoint = std::make_shared<aasdk::tcp::TCPEndpoint>(*tcpWrapper, socket);
+        auto transport = std::make_shared<aasdk::transport::TCPTransport>(m_ioService, endpoint);
         
-        // Stop USB hub
-        if (m_usbHub != nullptr) {
-            auto stopPromise = aasdk::io::PromisePtr<void>(
-                new aasdk::io::Promise<void>(
-                    []() {},
-                    [](const aasdk::error::Error&) {}
-                )
-            );
-            m_usbHub->stop(stopPromise);
-        }
-        
-        // Clear all shared pointers
-        m_controlServiceChannel.reset();
-        m_messenger.reset();
-        m_messageInStream.reset();
-        m_messageOutStream.reset();
-        m_cryptor.reset();
-        m_sslWrapper.reset();
-        m_transport.reset();
-        m_usbWrapper.reset();
-        m_usbHub.reset();
-        m_tcpWrapper.reset();
-    }
-    catch (const std::exception& ex) {
-        qDebug() << "Error shutting down Android Auto:" << ex.what();
-    }
-    
-    if (m_connected) {
-        m_connected = false;
-        emit connectedChanged();
-    }
+        // Session setup and teardown are driven from the GUI thread
+        QMetaObject::invokeMethod(this, [this, transport]() {
+            attachTransport(transport);
+        }, Qt::QueuedConnection);
+    });
 }
 
-// Control channel event handlers with corrected signatures
-void AndroidAuto::onServiceDiscoveryRequest(const aasdk::proto::messages::ServiceDiscoveryRequest& request,
-                                        aasdk::messenger::Timestamp::value_type timestamp)
+void AndroidAuto::attachTransport(std::shared_ptr<aasdk::transport::ITransport> transport)
 {
-    qDebug() << "Service discovery request received";
-    
-    aasdk::proto::messages::ServiceDiscoveryResponse response;
-    auto channelDesc1 = response.add_channel_descriptors();
-    channelDesc1->set_channel_id(aasdk::messenger::ChannelId::VIDEO);
-    
-    auto channelDesc2 = response.add_channel_descriptors();
-    channelDesc2->set_channel_id(aasdk::messenger::ChannelId::SENSOR);
-    
-    auto channelDesc3 = response.add_channel_descriptors();
-    channelDesc3->set_channel_id(aasdk::messenger::ChannelId::AV_INPUT);
-    
-    auto channelDesc4 = response.add_channel_descriptors();
-    channelDesc4->set_channel_id(aasdk::messenger::ChannelId::INPUT);
-    
-    auto channelDesc5 = response.add_channel_descriptors();
-    channelDesc5->set_channel_id(aasdk::messenger::ChannelId::NAVIGATION);
-    
-    auto sendPromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
-    
-    m_controlServiceChannel->sendServiceDiscoveryResponse(response, sendPromise);
-    
-    auto receivePromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
-    
-    m_controlServiceChannel->receive(this->shared_from_this(), receivePromise);
+    try {
+        startSession(std::move(transport));
+    }
+    catch(const std::exception& ex) {
+        qDebug() << "Exception during session setup:" << ex.what();
+        emit error(QString("Error during session setup: %1").arg(ex.what()));
+    }
 }
 
-void AndroidAuto::onAudioFocusRequest(const aasdk::proto::messages::AudioFocusRequest& request,
-                                   aasdk::messenger::Timestamp::value_type timestamp)
+void AndroidAuto::startSession(std::shared_ptr<aasdk::transport::ITransport> transport)
 {
-    qDebug() << "Audio focus request received";
+    QMutexLocker locker(&m_mutex);
     
-    aasdk::proto::messages::AudioFocusResponse response;
-    response.set_audio_focus_state(aasdk::proto::enums::AudioFocusState::GAIN);
+    // A new phone replaces whatever session is still running
+    stopSession(false);
     
-    auto sendPromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
+    // Handlers of this session carry its generation, so once it is retired they go quiet
+    const quint64 generation = m_sessionGeneration;
+    auto errorHandler = std::bind(&AndroidAuto::onChannelError, this, generation, std::placeholders::_1);
     
-    m_controlServiceChannel->sendAudioFocusResponse(response, sendPromise);
+    m_transport = std::move(transport);
+    m_firstFramePending = true;
+    FlightRecorder::record(FlightEvent::SessionStart, 0, generation);
     
-    auto receivePromise = aasdk::io::PromisePtr<void>(
+    auto startPromise = aasdk::io::PromisePtr<void>(
         new aasdk::io::Promise<void>(
             []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
+            errorHandler
         )
     );
     
-    m_controlServiceChannel->receive(this->shared_from_this(), receivePromise);
-}
-
-void AndroidAuto::onShutdownRequest(const aasdk::proto::messages::ShutdownRequest& request,
-                                 aasdk::messenger::Timestamp::value_type timestamp)
-{
-    qDebug() << "Shutdown request received";
+    m_transport->start(startPromise);
+    
+    // Set up cryptography on top of the shared SSL wrapper
+    m_cryptor = std::make_shared<aasdk::messenger::Cryptor>(m_sslWrapper);
+    m_cryptor->init();
+    
+    // Set up messenger
+    // Transport reads, decryption and dispatch run as separate stages
+    QSettings settings;
+    PipelinedMessageInStream::Config inStreamConfig;
+    inStreamConfig.readAhead = settings.value("messenger/readAhead", inStreamConfig.readAhead).toInt();
+    inStreamConfig.batchSize = settings.value("messenger/decryptBatch", inStreamConfig.batchSize).toInt();
+    m_messageInStream = std::make_shared<PipelinedMessageInStream>(m_ioService, m_transport, m_cryptor, inStreamConfig);
+    m_messageOutStream = std::make_shared<aasdk::messenger::MessageOutStream>(m_ioService, m_transport, m_cryptor);
+    m_messenger = std::make_shared<aasdk::messenger::Messenger>(m_ioService, m_messageInStream, m_messageOutStream);
+    
+    // Service channels, declared once in SessionChannels
+    m_channels = std::make_shared<SessionChannels>(
+        std::make_shared<VideoService>(m_strand, m_messenger, *m_videoDecoder, errorHandler),
+        std::make_shared<AVInputService>(m_strand, m_messenger, *m_audioCapture, errorHandler),
+        std::make_shared<NavigationService>(m_strand, m_messenger, *m_navigationState, errorHandler));
+    
+    // Set up control channel
+    m_controlService = std::make_shared<ControlService>(m_strand, m_messenger, m_cryptor, m_channels,
+        LinkMonitor::Config::fromSettings(settings),
+        [this, generation](const QString &reason) {
+            if (generation != m_sessionGeneration) {
+                return;
+            }
+            
+            // Anything but an orderly shutdown brings the placeholder back
+            if (!reason.isEmpty()) {
+                emit error(reason);
+            }
+            requestShutdown(generation, !reason.isEmpty());
+        },
+        errorHandler);
+    
+    // Channel traffic starts on the strand, where the session is later torn down
+    m_strand.dispatch([this, self = this->shared_from_this()]() {
+        if (m_controlService == nullptr) {
+            return;
+        }
+        
+        m_channels->start();
+        m_controlService->start();
+    });
     
-    aasdk::proto::messages::ShutdownResponse response;
+    m_connected = true;
+    emit connectedChanged();
     
-    auto sendPromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            [this]() {
-                shutdownAndroidAuto();
-            },
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
+    // Video surface is needed for decoded frames
+    if (!isActive()) {
+        QVideoSurfaceFormat format(QSize(800, 480), QVideoFrame::Format_RGB32);
+        start(format);
+    }
     
-    m_controlServiceChannel->sendShutdownResponse(response, sendPromise);
-}
-
-void AndroidAuto::onShutdownResponse(const aasdk::proto::messages::ShutdownResponse& response,
-                                  aasdk::messenger::Timestamp::value_type timestamp)
-{
-    qDebug() << "Shutdown response received";
-    shutdownAndroidAuto();
+    // Stop simulation
+    m_simulationTimer.stop();
+    
+    qDebug() << "Android Auto device setup complete";
 }
 
-void AndroidAuto::onNavigationFocusRequest(const aasdk::proto::messages::NavigationFocusRequest& request,
-                                        aasdk::messenger::Timestamp::value_type timestamp)
+void AndroidAuto::shutdownAndroidAuto()
 {
-    qDebug() << "Navigation focus request received";
-    
-    aasdk::proto::messages::NavigationFocusResponse response;
-    response.set_type(aasdk::proto::enums::NavigationFocusType::FOCUSED_NAVIGATION);
+    QMutexLocker locker(&m_mutex);
     
-    auto sendPromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
+    // Stop video surface
+    if (isActive()) {
+        stop();
+    }
     
-    m_controlServiceChannel->sendNavigationFocusResponse(response, sendPromise);
+    // Stop simulation timer
+    m_simulationTimer.stop();
     
-    auto receivePromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
+    stopSession(true);
     
-    m_controlServiceChannel->receive(this->shared_from_this(), receivePromise);
+    if (m_connected) {
+        m_connected = false;
+        emit connectedChanged();
+    }
 }
 
-void AndroidAuto::onNavigationFocusResponse(const aasdk::proto::messages::NavigationFocusResponse& response,
-                                         aasdk::messenger::Timestamp::value_type timestamp)
+void AndroidAuto::stopSession(bool releaseUsb)
 {
-    qDebug() << "Navigation focus response received";
+    FlightRecorder::record(FlightEvent::SessionStop, 0, m_sessionGeneration);
+    
+    // Errors still in flight from the old session must not tear down the next one
+    ++m_sessionGeneration;
+    m_firstFramePending = false;
+    
+    auto handedOver = std::make_shared<std::promise<void>>();
+    auto idle = std::make_shared<std::promise<void>>();
+    std::future<void> handedOverFuture = handedOver->get_future();
+    std::future<void> idleFuture = idle->get_future();
+    
+    // Members are taken on the strand so no channel handler sees a half torn down session
+    m_strand.dispatch([this, releaseUsb, handedOver, idle]() {
+        auto session = std::make_shared<RetiredSession>();
+        session->controlService = std::move(m_controlService);
+        session->channels = std::move(m_channels);
+        session->messenger = std::move(m_messenger);
+        session->messageInStream = std::move(m_messageInStream);
+        session->messageOutStream = std::move(m_messageOutStream);
+        session->cryptor = std::move(m_cryptor);
+        session->transport = std::move(m_transport);
+        if (releaseUsb) {
+            session->tcpWrapper = std::move(m_tcpWrapper);
+            session->usbHub = std::move(m_usbHub);
+            session->usbWrapper = std::move(m_usbWrapper);
+        }
+        session->idle = idle;
+        handedOver->set_value();
+        
+        // Released after the last stop completes, once the stopping call stacks have unwound
+        auto ioService = &m_ioService;
+        auto stopped = [session, ioService]() {
+            if (--session->pendingStops == 0) {
+                ioService->post([session]() {
+                    if (session->cryptor != nullptr) {
+                        session->cryptor->deinit();
+                    }
+                    auto idle = std::move(session->idle);
+                    *session = RetiredSession();
+                    idle->set_value();
+                });
+            }
+        };
+        auto stopPromise = [stopped]() {
+            return aasdk::io::PromisePtr<void>(
+                new aasdk::io::Promise<void>(
+                    [stopped]() { stopped(); },
+                    [stopped](const aasdk::error::Error&) { stopped(); }
+                )
+            );
+        };
+        
+        ++session->pendingStops;
+        
+        try {
+            // Stop the channels; video drops queued frames, the microphone joins its capture thread
+            if (session->controlService != nullptr) {
+                session->controlService->stop();
+            }
+            
+            if (session->channels != nullptr) {
+                session->channels->stop();
+            }
+            
+            // Pending receives fail instead of waiting for data that will never come
+            if (session->messenger != nullptr) {
+                session->messenger->stop();
+            }
+            
+            // Stop the decrypt worker before the cryptor goes away
+            if (session->messageInStream != nullptr) {
+                session->messageInStream->stop();
+            }
+            
+            if (session->transport != nullptr) {
+                ++session->pendingStops;
+                session->transport->stop(stopPromise());
+            }
+            
+            if (session->usbHub != nullptr) {
+                ++session->pendingStops;
+                session->usbHub->stop(stopPromise());
+            }
+        }
+        catch (const std::exception& ex) {
+            qDebug() << "Error shutting down Android Auto:" << ex.what();
+        }
+        
+        stopped();
+    });
     
-    auto receivePromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
+    // Called from the io thread the wait could never finish
+    if (std::this_thread::get_id() == m_ioServiceThread.get_id()) {
+        qWarning() << "Session teardown requested from the io thread, not waiting for it";
+        return;
+    }
     
-    m_controlServiceChannel->receive(this->shared_from_this(), receivePromise);
+    handedOverFuture.wait();
+    if (idleFuture.wait_for(std::chrono::milliseconds(m_teardownTimeoutMs)) != std::future_status::ready) {
+        ++m_stalledTeardowns;
+        FlightRecorder::record(FlightEvent::TeardownStalled, 0, static_cast<uint64_t>(m_teardownTimeoutMs));
+        qWarning() << "Session teardown did not finish within" << m_teardownTimeoutMs << "ms";
+    }
 }
 
-void AndroidAuto::onPingRequest(const aasdk::proto::messages::PingRequest& request,
-                             aasdk::messenger::Timestamp::value_type timestamp)
+void AndroidAuto::requestShutdown(quint64 generation, bool fallBackToSimulation)
 {
-    qDebug() << "Ping request received";
-    
-    aasdk::proto::messages::PingResponse response;
-    
-    auto sendPromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
-    
-    m_controlServiceChannel->sendPingResponse(response, sendPromise);
-    
-    auto receivePromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
-    
-    m_controlServiceChannel->receive(this->shared_from_this(), receivePromise);
+    // Handlers run on the io thread; teardown waits for it, so it runs on the GUI thread
+    QMetaObject::invokeMethod(this, [this, generation, fallBackToSimulation]() {
+        if (generation != m_sessionGeneration) {
+            return;
+        }
+        
+        shutdownAndroidAuto();
+        
+        if (fallBackToSimulation) {
+            m_simulationTimer.start(100);
+        }
+    }, Qt::QueuedConnection);
 }
 
-void AndroidAuto::onPingResponse(const aasdk::proto::messages::PingResponse& response,
-                              aasdk::messenger::Timestamp::value_type timestamp)
+void AndroidAuto::onChannelError(quint64 generation, const aasdk::error::Error& e)
 {
-    qDebug() << "Ping response received";
-    
-    auto receivePromise = aasdk::io::PromisePtr<void>(
-        new aasdk::io::Promise<void>(
-            []() {},
-            std::bind(&AndroidAuto::onChannelError, this, std::placeholders::_1)
-        )
-    );
+    if (generation != m_sessionGeneration) {
+        qDebug() << "Ignoring error from a retired session:" << e.what();
+        return;
+    }
     
-    m_controlServiceChannel->receive(this->shared_from_this(), receivePromise);
-}
-
-void AndroidAuto::onChannelError(const aasdk::error::Error& e)
-{
     qDebug() << "Channel error:" << e.what();
-    
-    shutdownAndroidAuto();
+    FlightRecorder::record(FlightEvent::Error, 0, static_cast<uint64_t>(e.getCode()),
+                           static_cast<uint64_t>(e.getNativeCode()), e.what());
     
     // Fall back to simulation mode
-    m_simulationTimer.start(100);
+    requestShutdown(generation, true);
 }
@@ -6,17 +6,28 @@
 #include <QVideoSurfaceFormat>
 #include <QMutex>
 #include <QTimer>
+#include <atomic>
 #include <memory>
 #include <boost/asio.hpp>
 #include <thread>
 
-// Include the actual header for IControlServiceChannelEventHandler
-#include <aasdk/Channel/Control/IControlServiceChannelEventHandler.hpp>
 
 // Forward declaration for libusb
+struct libusb_context;
 struct libusb_device_handle;
 
+class VideoDecoder;
+class ControlService;
+class SessionChannels;
+class NavigationState;
+class AudioCapture;
+class CachingSSLWrapper;
+class PipelinedMessageInStream;
+
 namespace aasdk {
+    namespace error {
+        class Error;
+    }
     namespace usb {
         class IUSBWrapper;
         class USBWrapper;
@@ -62,17 +73,29 @@ namespace aasdk {
 }
 
 class AndroidAuto : public QAbstractVideoSurface, 
-                    public aasdk::channel::control::IControlServiceChannelEventHandler,
                     public std::enable_shared_from_this<AndroidAuto>
 {
     Q_OBJECT
     Q_PROPERTY(bool connected READ isConnected NOTIFY connectedChanged)
+    Q_PROPERTY(double handshakeMs READ handshakeMs NOTIFY handshakeCompleted)
+    Q_PROPERTY(bool sessionResumed READ sessionResumed NOTIFY handshakeCompleted)
     
 public:
     explicit AndroidAuto(QObject *parent = nullptr);
     ~AndroidAuto() override;
     
     bool isConnected() const;
+    double handshakeMs() const;
+    bool sessionResumed() const;
+    // Turn-by-turn state from the phone, updated at most once per frame
+    NavigationState *navigation() const;
+    // Teardowns that did not reach idle within session/teardownTimeoutMs
+    quint64 stalledTeardowns() const;
+    
+    // For transports created outside this class, e.g. by the stress harness
+    boost::asio::io_service &ioService();
+    // Starts a session on an already connected transport, replacing any current one
+    void attachTransport(std::shared_ptr<aasdk::transport::ITransport> transport);
     
     // QAbstractVideoSurface interface
     QList<QVideoFrame::PixelFormat> supportedPixelFormats(
@@ -81,35 +104,29 @@ public:
     bool present(const QVideoFrame &frame) override;
     void stop() override;
     
-    // Control channel event handlers
-    void onServiceDiscoveryRequest(const aasdk::proto::messages::ServiceDiscoveryRequest& request,
-                                 aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onAudioFocusRequest(const aasdk::proto::messages::AudioFocusRequest& request,
-                           aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onShutdownRequest(const aasdk::proto::messages::ShutdownRequest& request,
-                         aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onShutdownResponse(const aasdk::proto::messages::ShutdownResponse& response,
-                          aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onNavigationFocusRequest(const aasdk::proto::messages::NavigationFocusRequest& request,
-                                aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onNavigationFocusResponse(const aasdk::proto::messages::NavigationFocusResponse& response,
-                                 aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onPingRequest(const aasdk::proto::messages::PingRequest& request,
-                     aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onPingResponse(const aasdk::proto::messages::PingResponse& response,
-                      aasdk::messenger::Timestamp::value_type timestamp) override;
-    void onChannelError(const aasdk::error::Error& e) override;
-    
 public slots:
     void onDeviceConnected(const QString &deviceId);
     void onDeviceDisconnected(const QString &deviceId);
+    // Runs a session against aaqt_phone_emulator (or a wireless phone) over TCP
+    void connectLoopback(const QString &host, quint16 port);
     
 signals:
     void connectedChanged();
+    void handshakeCompleted();
+    void firstFramePresented();
+    // TLS, protobuf and AES set-up has run on its background thread
+    void warmedUp();
     void error(const QString &message);
     
 private:
     bool m_connected;
+    double m_handshakeMs;
+    bool m_sessionResumed;
+    bool m_firstFramePending;
+    // Bumped on every teardown so errors from a retired session are ignored
+    std::atomic<quint64> m_sessionGeneration;
+    quint64 m_stalledTeardowns;
+    int m_teardownTimeoutMs;
     QVideoSurfaceFormat m_format;
     QMutex m_mutex;
     QTimer m_simulationTimer;
@@ -118,24 +135,42 @@ private:
     boost::asio::io_service m_ioService;
     std::shared_ptr<boost::asio::io_service::work> m_workLoopKeepAlive;
     boost::asio::io_service::strand m_strand;
+    libusb_context *m_usbContext;
     std::shared_ptr<aasdk::usb::IUSBWrapper> m_usbWrapper;
     std::shared_ptr<aasdk::usb::IUSBHub> m_usbHub;
     std::shared_ptr<aasdk::tcp::ITCPWrapper> m_tcpWrapper;
     std::shared_ptr<aasdk::transport::ITransport> m_transport;
-    std::shared_ptr<aasdk::transport::ISSLWrapper> m_sslWrapper;
+    // Shared across sessions so the TLS context and last session survive reconnects
+    std::shared_ptr<CachingSSLWrapper> m_sslWrapper;
     std::shared_ptr<aasdk::messenger::ICryptor> m_cryptor;
-    std::shared_ptr<aasdk::messenger::IMessageInStream> m_messageInStream;
+    std::shared_ptr<PipelinedMessageInStream> m_messageInStream;
     std::shared_ptr<aasdk::messenger::IMessageOutStream> m_messageOutStream;
     std::shared_ptr<aasdk::messenger::IMessenger> m_messenger;
-    std::shared_ptr<aasdk::channel::control::IControlServiceChannel> m_controlServiceChannel;
+    std::shared_ptr<ControlService> m_controlService;
+    std::shared_ptr<SessionChannels> m_channels;
+    
+    // Decode stage outlives sessions so codec threads are not respawned on reconnect
+    VideoDecoder *m_videoDecoder;
+    // Likewise the microphone; the capture thread only runs while the phone has it open
+    std::unique_ptr<AudioCapture> m_audioCapture;
+    NavigationState *m_navigationState;
     
     std::thread m_ioServiceThread;
+    std::thread m_warmUpThread;
     
     void initializeAndroidAuto(const QString &deviceId);
     void shutdownAndroidAuto();
+    // Stops the running session and waits until its in-flight operations have drained
+    void stopSession(bool releaseUsb);
+    // Schedules shutdownAndroidAuto() on the GUI thread from an io thread handler;
+    // dropped if the session of that generation has been torn down meanwhile
+    void requestShutdown(quint64 generation, bool fallBackToSimulation);
     void startIOServiceThread();
     void stopIOServiceThread();
+    void warmUp();
     void handleUSBDevice(std::shared_ptr<libusb_device_handle> deviceHandle);
+    void startSession(std::shared_ptr<aasdk::transport::ITransport> transport);
+    void onChannelError(quint64 generation, const aasdk::error::Error& e);
     
     // Promise handlers
     void onEnumerateResult(std::shared_ptr<libusb_device_handle> handle);
@@ -143,6 +178,7 @@ private:
 
 private slots:
     void simulateFrame();
+    void onVideoFrame(const QVideoFrame &frame);
 };
 
 #endif // ANDROIDAUTO_H
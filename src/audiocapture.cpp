@@ -0,0 +1,340 @@
+#include "audiocapture.h"
+#include "flightrecorder.h"
+#include "threadpolicy.h"
+#include <QDebug>
+#include <QFile>
+#include <QSettings>
+#include <algorithm>
+#include <cstring>
+
+#ifdef AAQT_HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+// Device backends. read() returns the frames read, 0 after a recovered
+// overrun and a negative value when capture cannot continue.
+class AudioCapture::Source
+{
+public:
+    virtual ~Source() = default;
+    virtual bool open() = 0;
+    virtual int read(int16_t *buffer, int frames) = 0;
+};
+
+namespace {
+
+#ifdef AAQT_HAVE_ALSA
+class AlsaSource : public AudioCapture::Source
+{
+public:
+    AlsaSource(const AudioCapture::Config &config, int periodFrames)
+        : m_config(config),
+          m_periodFrames(periodFrames),
+          m_pcm(nullptr)
+    {
+    }
+
+    ~AlsaSource() override
+    {
+        if (m_pcm != nullptr) {
+            snd_pcm_close(m_pcm);
+        }
+    }
+
+    bool open() override
+    {
+        int rc = snd_pcm_open(&m_pcm, m_config.device.toLocal8Bit().constData(), SND_PCM_STREAM_CAPTURE, 0);
+        if (rc < 0) {
+            qWarning() << "Unable to open capture device" << m_config.device << snd_strerror(rc);
+            m_pcm = nullptr;
+            return false;
+        }
+
+        // Short periods keep capture latency low; four of them give the thread slack
+        snd_pcm_hw_params_t *params;
+        snd_pcm_hw_params_alloca(&params);
+        snd_pcm_hw_params_any(m_pcm, params);
+        snd_pcm_hw_params_set_access(m_pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED);
+        snd_pcm_hw_params_set_format(m_pcm, params, SND_PCM_FORMAT_S16_LE);
+        snd_pcm_hw_params_set_channels(m_pcm, params, m_config.channels);
+        unsigned int rate = m_config.sampleRate;
+        snd_pcm_hw_params_set_rate_near(m_pcm, params, &rate, nullptr);
+        snd_pcm_uframes_t period = m_periodFrames;
+        snd_pcm_hw_params_set_period_size_near(m_pcm, params, &period, nullptr);
+        snd_pcm_uframes_t buffer = period * 4;
+        snd_pcm_hw_params_set_buffer_size_near(m_pcm, params, &buffer);
+
+        rc = snd_pcm_hw_params(m_pcm, params);
+        if (rc < 0 || rate != static_cast<unsigned int>(m_config.sampleRate)) {
+            qWarning() << "Capture device" << m_config.device << "does not support"
+                       << m_config.sampleRate << "Hz," << m_config.channels << "channels:" << snd_strerror(rc);
+            return false;
+        }
+
+        qDebug() << "Capturing from" << m_config.device << "period" << period << "frames, buffer" << buffer;
+        return snd_pcm_start(m_pcm) == 0 || snd_pcm_state(m_pcm) == SND_PCM_STATE_RUNNING;
+    }
+
+    int read(int16_t *buffer, int frames) override
+    {
+        const snd_pcm_sframes_t rc = snd_pcm_readi(m_pcm, buffer, frames);
+        if (rc >= 0) {
+            return static_cast<int>(rc);
+        }
+
+        if (snd_pcm_recover(m_pcm, static_cast<int>(rc), 1) < 0) {
+            qWarning() << "Capture failed:" << snd_strerror(static_cast<int>(rc));
+            return -1;
+        }
+        snd_pcm_start(m_pcm);
+        return 0;
+    }
+
+private:
+    const AudioCapture::Config m_config;
+    const int m_periodFrames;
+    snd_pcm_t *m_pcm;
+};
+#endif
+
+// Replays a WAV file in a loop at the real-time rate, for tests and benches
+class WavSource : public AudioCapture::Source
+{
+public:
+    WavSource(const AudioCapture::Config &config, const QString &path, int periodFrames)
+        : m_config(config),
+          m_path(path),
+          m_period(std::chrono::microseconds(1000000LL * periodFrames / config.sampleRate)),
+          m_position(0)
+    {
+    }
+
+    bool open() override
+    {
+        QFile file(m_path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Unable to open" << m_path;
+            return false;
+        }
+
+        const QByteArray data = file.readAll();
+        if (data.size() < 12 || !data.startsWith("RIFF") || data.mid(8, 4) != "WAVE") {
+            qWarning() << m_path << "is not a WAV file";
+            return false;
+        }
+
+        bool formatOk = false;
+        int offset = 12;
+        while (offset + 8 <= data.size()) {
+            const QByteArray id = data.mid(offset, 4);
+            quint32 size;
+            std::memcpy(&size, data.constData() + offset + 4, sizeof(size));
+            const int body = offset + 8;
+
+            if (id == "fmt " && size >= 16) {
+                quint16 format, channels, bits;
+                quint32 rate;
+                std::memcpy(&format, data.constData() + body, 2);
+                std::memcpy(&channels, data.constData() + body + 2, 2);
+                std::memcpy(&rate, data.constData() + body + 4, 4);
+                std::memcpy(&bits, data.constData() + body + 14, 2);
+                formatOk = format == 1 && bits == 16 && channels == m_config.channels
+                           && rate == static_cast<quint32>(m_config.sampleRate);
+            } else if (id == "data") {
+                const int bytes = std::min<int>(size, data.size() - body);
+                m_samples.resize(bytes / sizeof(int16_t));
+                std::memcpy(m_samples.data(), data.constData() + body, m_samples.size() * sizeof(int16_t));
+            }
+
+            offset = body + size + (size & 1);
+        }
+
+        if (!formatOk || m_samples.empty()) {
+            qWarning() << m_path << "must be 16-bit PCM," << m_config.sampleRate << "Hz," << m_config.channels << "channels";
+            return false;
+        }
+
+        m_nextPeriod = std::chrono::steady_clock::now() + m_period;
+        return true;
+    }
+
+    int read(int16_t *buffer, int frames) override
+    {
+        std::this_thread::sleep_until(m_nextPeriod);
+        m_nextPeriod += m_period;
+
+        const size_t count = static_cast<size_t>(frames) * m_config.channels;
+        for (size_t i = 0; i < count; ++i) {
+            buffer[i] = m_samples[m_position];
+            m_position = (m_position + 1) % m_samples.size();
+        }
+        return frames;
+    }
+
+private:
+    const AudioCapture::Config m_config;
+    const QString m_path;
+    const std::chrono::microseconds m_period;
+    std::vector<int16_t> m_samples;
+    size_t m_position;
+    std::chrono::steady_clock::time_point m_nextPeriod;
+};
+
+}
+
+AudioCapture::Config AudioCapture::Config::fromSettings(QSettings &settings)
+{
+    Config config;
+
+    settings.beginGroup("audio");
+    config.device = settings.value("captureDevice", config.device).toString();
+    config.periodMs = settings.value("capturePeriodMs", config.periodMs).toInt();
+    config.ringPeriods = settings.value("captureRingPeriods", config.ringPeriods).toInt();
+    settings.endGroup();
+
+    return config;
+}
+
+AudioCapture::AudioCapture(const Config &config)
+    : m_config(config),
+      m_periodFrames(config.sampleRate * config.periodMs / 1000),
+      m_ring(config.ringPeriods, Period{std::vector<int16_t>(m_periodFrames * config.channels), {}}),
+      m_running(false),
+      m_capturedPeriods(0),
+      m_overruns(0)
+{
+}
+
+AudioCapture::~AudioCapture()
+{
+    stop();
+}
+
+void AudioCapture::setDataReadyHandler(DataReadyHandler handler)
+{
+    m_dataReadyHandler = std::move(handler);
+}
+
+void AudioCapture::start()
+{
+    if (m_running) {
+        return;
+    }
+
+    // A previous capture may have ended on its own after a device error
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    m_running = true;
+    m_thread = std::thread([this]() {
+        run();
+    });
+}
+
+void AudioCapture::stop()
+{
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    while (readPeriod() != nullptr) {
+        releasePeriod();
+    }
+}
+
+bool AudioCapture::isRunning() const
+{
+    return m_running;
+}
+
+const AudioCapture::Period *AudioCapture::readPeriod()
+{
+    return m_ring.readSlot();
+}
+
+void AudioCapture::releasePeriod()
+{
+    m_ring.release();
+}
+
+const AudioCapture::Config &AudioCapture::config() const
+{
+    return m_config;
+}
+
+int AudioCapture::periodFrames() const
+{
+    return m_periodFrames;
+}
+
+quint64 AudioCapture::capturedPeriods() const
+{
+    return m_capturedPeriods;
+}
+
+quint64 AudioCapture::overruns() const
+{
+    return m_overruns;
+}
+
+void AudioCapture::run()
+{
+    ThreadPolicy::apply("mic");
+
+    std::unique_ptr<Source> source;
+    if (m_config.device.startsWith("wav:")) {
+        source.reset(new WavSource(m_config, m_config.device.mid(4), m_periodFrames));
+    } else {
+#ifdef AAQT_HAVE_ALSA
+        source.reset(new AlsaSource(m_config, m_periodFrames));
+#else
+        qWarning() << "Built without ALSA; only wav: capture devices are available";
+#endif
+    }
+
+    if (source == nullptr || !source->open()) {
+        m_running = false;
+        return;
+    }
+
+    // Periods that cannot be published are read into scratch and dropped,
+    // so the device keeps running and the loss is counted, not hidden
+    std::vector<int16_t> scratch(m_periodFrames * m_config.channels);
+
+    while (m_running) {
+        Period *period = m_ring.writeSlot();
+        int16_t *buffer = period != nullptr ? period->samples.data() : scratch.data();
+
+        int filled = 0;
+        while (filled < m_periodFrames && m_running) {
+            const int rc = source->read(buffer + filled * m_config.channels, m_periodFrames - filled);
+            if (rc < 0) {
+                m_running = false;
+                break;
+            }
+            if (rc == 0) {
+                FlightRecorder::record(FlightEvent::AudioOverrun, 0, ++m_overruns);
+            }
+            filled += rc;
+        }
+
+        if (filled < m_periodFrames) {
+            break;
+        }
+
+        ++m_capturedPeriods;
+        if (period == nullptr) {
+            FlightRecorder::record(FlightEvent::AudioOverrun, 0, ++m_overruns);
+            continue;
+        }
+
+        period->capturedAt = std::chrono::steady_clock::now();
+        m_ring.publish();
+
+        if (m_dataReadyHandler) {
+            m_dataReadyHandler();
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef AUDIOCAPTURE_H
+#define AUDIOCAPTURE_H
+
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "spscring.h"
+
+class QSettings;
+
+// Microphone capture for the AV_INPUT channel. A dedicated thread reads the
+// device in short periods and publishes each one into a lock-free ring of
+// preallocated periods, which the sending side drains on the io thread.
+class AudioCapture
+{
+public:
+    struct Config
+    {
+        int sampleRate = 16000;
+        int channels = 1;
+        int periodMs = 10;
+        // Periods buffered before capture starts counting overruns
+        int ringPeriods = 32;
+        // ALSA PCM name, or "wav:<path>" to replay a 16-bit PCM file in real time
+        QString device = "default";
+
+        static Config fromSettings(QSettings &settings);
+    };
+
+    struct Period
+    {
+        std::vector<int16_t> samples;
+        // When the last sample of the period was captured
+        std::chrono::steady_clock::time_point capturedAt;
+    };
+
+    typedef std::function<void()> DataReadyHandler;
+
+    explicit AudioCapture(const Config &config);
+    ~AudioCapture();
+
+    // Runs on the capture thread after every published period, so it must not block
+    void setDataReadyHandler(DataReadyHandler handler);
+
+    // Starts the capture thread; the device is opened on that thread
+    void start();
+    // Stops and joins the capture thread and drops anything still buffered
+    void stop();
+    bool isRunning() const;
+
+    // Consumer side, one thread only
+    const Period *readPeriod();
+    void releasePeriod();
+
+    const Config &config() const;
+    int periodFrames() const;
+    quint64 capturedPeriods() const;
+    // Device overruns plus periods dropped because the ring was full
+    quint64 overruns() const;
+
+    class Source;
+
+private:
+    void run();
+
+    const Config m_config;
+    const int m_periodFrames;
+    SpscRing<Period> m_ring;
+    DataReadyHandler m_dataReadyHandler;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<quint64> m_capturedPeriods;
+    std::atomic<quint64> m_overruns;
+};
+
+#endif // AUDIOCAPTURE_H
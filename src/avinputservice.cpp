@@ -0,0 +1,223 @@
+#include "avinputservice.h"
+#include "audiocapture.h"
+#include <QDebug>
+#include <cstring>
+
+#include <aasdk_proto/ChannelOpenRequestMessage.pb.h>
+#include <aasdk_proto/ChannelOpenResponseMessage.pb.h>
+#include <aasdk_proto/AVChannelSetupRequestMessage.pb.h>
+#include <aasdk_proto/AVChannelSetupResponseMessage.pb.h>
+#include <aasdk_proto/AVChannelStartIndicationMessage.pb.h>
+#include <aasdk_proto/AVInputOpenRequestMessage.pb.h>
+#include <aasdk_proto/AVInputOpenResponseMessage.pb.h>
+#include <aasdk_proto/AVMediaAckIndicationMessage.pb.h>
+
+namespace {
+
+// Packets between latency reports while the microphone is open
+const quint64 cReportInterval = 1000;
+
+}
+
+AVInputService::AVInputService(boost::asio::io_service::strand &strand,
+                               std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                               AudioCapture &capture,
+                               ErrorHandler errorHandler)
+    : ServiceChannel<AVInputService>(strand, std::move(messenger), aasdk::messenger::ChannelId::AV_INPUT),
+      m_capture(capture),
+      m_errorHandler(std::move(errorHandler)),
+      m_session(0),
+      m_capturing(false),
+      m_drainScheduled(false),
+      m_maxUnacked(0),
+      m_unacked(0),
+      m_packetsSent(0),
+      m_overrunsAtStart(0),
+      m_latencyTotal(0),
+      m_latencyMax(0)
+{
+    m_packet.reserve(capture.periodFrames() * capture.config().channels * sizeof(int16_t));
+}
+
+AVInputService::~AVInputService()
+{
+    // The capture thread calls back into this object
+    stopCapture();
+}
+
+void AVInputService::start()
+{
+    startReceiving();
+}
+
+void AVInputService::stop()
+{
+    stopReceiving();
+    stopCapture();
+}
+
+void AVInputService::fillFeatures(aasdk::proto::messages::ServiceDiscoveryResponse &response)
+{
+    const AudioCapture::Config &config = m_capture.config();
+
+    auto avInputChannel = addDescriptor(response)->mutable_av_input_channel();
+    avInputChannel->set_stream_type(aasdk::proto::enums::AVStreamType::AUDIO);
+    avInputChannel->set_available_while_in_call(true);
+
+    auto audioConfig = avInputChannel->mutable_audio_config();
+    audioConfig->set_sample_rate(config.sampleRate);
+    audioConfig->set_bit_depth(16);
+    audioConfig->set_channel_count(config.channels);
+}
+
+void AVInputService::onChannelOpenRequest(const aasdk::proto::messages::ChannelOpenRequest& request)
+{
+    qDebug() << "Microphone channel open request, priority" << request.priority();
+
+    aasdk::proto::messages::ChannelOpenResponse response;
+    response.set_status(aasdk::proto::enums::Status::OK);
+    sendControl(aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_RESPONSE, response);
+}
+
+void AVInputService::onAVChannelSetupRequest(const aasdk::proto::messages::AVChannelSetupRequest& request)
+{
+    qDebug() << "Microphone channel setup request, config index" << request.config_index();
+
+    aasdk::proto::messages::AVChannelSetupResponse response;
+    response.set_media_status(aasdk::proto::enums::AVChannelSetupStatus::OK);
+    response.set_max_unacked(1);
+    response.add_configs(0);
+    send(aasdk::proto::ids::AVChannelMessage::SETUP_RESPONSE, response);
+}
+
+void AVInputService::onAVChannelStartIndication(const aasdk::proto::messages::AVChannelStartIndication& indication)
+{
+    qDebug() << "Microphone stream started, session" << indication.session();
+    m_session = indication.session();
+}
+
+void AVInputService::onAVInputOpenRequest(const aasdk::proto::messages::AVInputOpenRequest& request)
+{
+    qDebug() << "Microphone" << (request.open() ? "open" : "close") << "request, session" << m_session
+             << ", max unacked" << request.max_unacked();
+
+    // Capture follows the phone: it opens the microphone for the assistant and closes it after
+    if (request.open()) {
+        m_maxUnacked = request.max_unacked();
+        startCapture();
+    } else {
+        stopCapture();
+    }
+
+    aasdk::proto::messages::AVInputOpenResponse response;
+    response.set_session(m_session);
+    response.set_value(0);
+    send(aasdk::proto::ids::AVChannelMessage::AV_INPUT_OPEN_RESPONSE, response);
+}
+
+void AVInputService::onAVMediaAckIndication(const aasdk::proto::messages::AVMediaAckIndication& indication)
+{
+    m_unacked = std::max(0, m_unacked - static_cast<int>(std::max<uint32_t>(1, indication.value())));
+
+    // Periods held back by the ack window can go now
+    drain();
+}
+
+void AVInputService::onChannelError(const aasdk::error::Error& e)
+{
+    qDebug() << "Microphone channel error:" << e.what();
+    stopCapture();
+
+    if (m_errorHandler) {
+        m_errorHandler(e);
+    }
+}
+
+void AVInputService::startCapture()
+{
+    if (m_capturing || isStopped()) {
+        return;
+    }
+
+    m_capturing = true;
+    m_unacked = 0;
+    m_packetsSent = 0;
+    m_overrunsAtStart = m_capture.overruns();
+    m_latencyTotal = std::chrono::microseconds(0);
+    m_latencyMax = std::chrono::microseconds(0);
+
+    // Runs on the capture thread; one drain is queued at a time however fast periods arrive
+    std::weak_ptr<AVInputService> weakSelf = this->shared_from_this();
+    m_capture.setDataReadyHandler([this, weakSelf]() {
+        if (!m_drainScheduled.exchange(true)) {
+            m_strand.post([weakSelf]() {
+                if (auto self = weakSelf.lock()) {
+                    self->m_drainScheduled = false;
+                    self->drain();
+                }
+            });
+        }
+    });
+    m_capture.start();
+}
+
+void AVInputService::stopCapture()
+{
+    if (!m_capturing) {
+        return;
+    }
+
+    m_capturing = false;
+    m_capture.stop();
+    m_capture.setDataReadyHandler(nullptr);
+
+    const quint64 overruns = m_capture.overruns() - m_overrunsAtStart;
+    qDebug() << "Microphone closed:" << m_packetsSent << "packets, capture-to-send latency avg"
+             << (m_packetsSent > 0 ? m_latencyTotal.count() / 1000.0 / m_packetsSent : 0.0) << "ms, max"
+             << m_latencyMax.count() / 1000.0 << "ms," << overruns << "overruns";
+}
+
+void AVInputService::drain()
+{
+    while (m_capturing) {
+        // The phone bounds how many packets may wait for an ack
+        if (m_maxUnacked > 0 && m_unacked >= m_maxUnacked) {
+            return;
+        }
+
+        const AudioCapture::Period *period = m_capture.readPeriod();
+        if (period == nullptr) {
+            return;
+        }
+
+        const size_t bytes = period->samples.size() * sizeof(int16_t);
+        m_packet.resize(bytes);
+        std::memcpy(m_packet.data(), period->samples.data(), bytes);
+        const std::chrono::steady_clock::time_point capturedAt = period->capturedAt;
+        m_capture.releasePeriod();
+
+        TimestampedMedia media;
+        media.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(capturedAt.time_since_epoch()).count();
+        media.data = aasdk::common::DataConstBuffer(m_packet);
+
+        send(aasdk::proto::ids::AVChannelMessage::AV_MEDIA_WITH_TIMESTAMP_INDICATION, media,
+             [this, self = this->shared_from_this(), capturedAt]() {
+                 onPacketSent(capturedAt);
+             });
+        ++m_unacked;
+    }
+}
+
+void AVInputService::onPacketSent(std::chrono::steady_clock::time_point capturedAt)
+{
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - capturedAt);
+    m_latencyTotal += latency;
+    m_latencyMax = std::max(m_latencyMax, latency);
+    ++m_packetsSent;
+
+    if (m_packetsSent % cReportInterval == 0) {
+        qDebug() << "Microphone: capture-to-send latency avg" << m_latencyTotal.count() / 1000.0 / m_packetsSent
+                 << "ms, max" << m_latencyMax.count() / 1000.0 << "ms,"
+                 << m_capture.overruns() - m_overrunsAtStart << "overruns";
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef AVINPUTSERVICE_H
+#define AVINPUTSERVICE_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+
+#include "servicechannel.h"
+
+#include <aasdk_proto/ControlMessageIdsEnum.pb.h>
+#include <aasdk_proto/AVChannelMessageIdsEnum.pb.h>
+
+class AudioCapture;
+
+namespace aasdk {
+    namespace proto {
+        namespace messages {
+            class ChannelOpenRequest;
+            class AVChannelSetupRequest;
+            class AVChannelStartIndication;
+            class AVInputOpenRequest;
+            class AVMediaAckIndication;
+        }
+    }
+}
+
+// Handles the AV_INPUT channel: captures the microphone while the phone has
+// it open and sends each captured period as soon as it is available.
+class AVInputService : public ServiceChannel<AVInputService>
+{
+public:
+    typedef std::function<void(const aasdk::error::Error&)> ErrorHandler;
+
+    AVInputService(boost::asio::io_service::strand &strand,
+                   std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                   AudioCapture &capture,
+                   ErrorHandler errorHandler);
+    ~AVInputService();
+
+    void start();
+    void stop();
+    void fillFeatures(aasdk::proto::messages::ServiceDiscoveryResponse &response);
+
+    void onChannelOpenRequest(const aasdk::proto::messages::ChannelOpenRequest& request);
+    void onAVChannelSetupRequest(const aasdk::proto::messages::AVChannelSetupRequest& request);
+    void onAVChannelStartIndication(const aasdk::proto::messages::AVChannelStartIndication& indication);
+    void onAVInputOpenRequest(const aasdk::proto::messages::AVInputOpenRequest& request);
+    void onAVMediaAckIndication(const aasdk::proto::messages::AVMediaAckIndication& indication);
+    void onChannelError(const aasdk::error::Error& e);
+
+    typedef HandlerList<
+        On<AVInputService, aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_REQUEST,
+           aasdk::proto::messages::ChannelOpenRequest, &AVInputService::onChannelOpenRequest>,
+        On<AVInputService, aasdk::proto::ids::AVChannelMessage::AV_MEDIA_ACK_INDICATION,
+           aasdk::proto::messages::AVMediaAckIndication, &AVInputService::onAVMediaAckIndication>,
+        On<AVInputService, aasdk::proto::ids::AVChannelMessage::SETUP_REQUEST,
+           aasdk::proto::messages::AVChannelSetupRequest, &AVInputService::onAVChannelSetupRequest>,
+        On<AVInputService, aasdk::proto::ids::AVChannelMessage::START_INDICATION,
+           aasdk::proto::messages::AVChannelStartIndication, &AVInputService::onAVChannelStartIndication>,
+        On<AVInputService, aasdk::proto::ids::AVChannelMessage::AV_INPUT_OPEN_REQUEST,
+           aasdk::proto::messages::AVInputOpenRequest, &AVInputService::onAVInputOpenRequest>
+    > Handlers;
+
+private:
+    void startCapture();
+    void stopCapture();
+    void drain();
+    void onPacketSent(std::chrono::steady_clock::time_point capturedAt);
+
+    AudioCapture &m_capture;
+    ErrorHandler m_errorHandler;
+    // Announced by the phone's start indication and echoed in every open response
+    int32_t m_session;
+    bool m_capturing;
+
+    // Set by the capture thread, cleared when the drain runs on the strand
+    std::atomic<bool> m_drainScheduled;
+    int m_maxUnacked;
+    int m_unacked;
+    // Reused for every packet; sized for one capture period
+    aasdk::common::Data m_packet;
+
+    quint64 m_packetsSent;
+    quint64 m_overrunsAtStart;
+    std::chrono::microseconds m_latencyTotal;
+    std::chrono::microseconds m_latencyMax;
+};
+
+#endif // AVINPUTSERVICE_H
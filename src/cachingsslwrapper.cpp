@@ -0,0 +1,257 @@
+#include "cachingsslwrapper.h"
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+
+#include <aasdk/Messenger/Cryptor.hpp>
+#include <aasdk/Error/Error.hpp>
+
+CachingSSLWrapper::CachingSSLWrapper()
+    : m_context(nullptr),
+      m_contextCertificate(nullptr),
+      m_contextPrivateKey(nullptr),
+      m_session(nullptr),
+      m_handshakeCount(0),
+      m_resumedCount(0),
+      m_lastHandshakeUs(0)
+{
+}
+
+CachingSSLWrapper::~CachingSSLWrapper()
+{
+    // Released before the base class tears down the OpenSSL globals
+    if (m_session != nullptr) {
+        SSL_SESSION_free(m_session);
+    }
+    if (m_context != nullptr) {
+        SSL_CTX_free(m_context);
+    }
+    for (auto &certificate : m_certificates) {
+        X509_free(certificate.second);
+    }
+    for (auto &privateKey : m_privateKeys) {
+        EVP_PKEY_free(privateKey.second);
+    }
+}
+
+void CachingSSLWrapper::preload()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    try {
+        aasdk::messenger::Cryptor cryptor(shared_from_this());
+        cryptor.init();
+        cryptor.deinit();
+        qDebug() << "TLS context preloaded in" << timer.elapsed() << "ms";
+    }
+    catch (const aasdk::error::Error& e) {
+        qWarning() << "Unable to preload TLS context:" << e.what();
+    }
+}
+
+void CachingSSLWrapper::setHandshakeListener(HandshakeListener listener)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_handshakeListener = std::move(listener);
+}
+
+void CachingSSLWrapper::forgetSession()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_session != nullptr) {
+        SSL_SESSION_free(m_session);
+        m_session = nullptr;
+    }
+}
+
+quint64 CachingSSLWrapper::handshakeCount() const
+{
+    return m_handshakeCount;
+}
+
+quint64 CachingSSLWrapper::resumedCount() const
+{
+    return m_resumedCount;
+}
+
+qint64 CachingSSLWrapper::lastHandshakeUs() const
+{
+    return m_lastHandshakeUs;
+}
+
+X509* CachingSSLWrapper::readCertificate(const std::string& certificate)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_certificates.find(certificate);
+    if (it == m_certificates.end()) {
+        X509* parsed = SSLWrapper::readCertificate(certificate);
+        if (parsed == nullptr) {
+            return nullptr;
+        }
+        it = m_certificates.emplace(certificate, parsed).first;
+    }
+
+    // The caller releases its reference through free(X509*)
+    X509_up_ref(it->second);
+    return it->second;
+}
+
+EVP_PKEY* CachingSSLWrapper::readPrivateKey(const std::string& privateKey)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_privateKeys.find(privateKey);
+    if (it == m_privateKeys.end()) {
+        EVP_PKEY* parsed = SSLWrapper::readPrivateKey(privateKey);
+        if (parsed == nullptr) {
+            return nullptr;
+        }
+        it = m_privateKeys.emplace(privateKey, parsed).first;
+    }
+
+    EVP_PKEY_up_ref(it->second);
+    return it->second;
+}
+
+SSL_CTX* CachingSSLWrapper::createContext(const SSL_METHOD* method)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_context == nullptr) {
+        m_context = SSLWrapper::createContext(method);
+        if (m_context == nullptr) {
+            return nullptr;
+        }
+
+        // Sessions are kept by the wrapper rather than OpenSSL's internal
+        // cache, which only applies to servers anyway
+        SSL_CTX_set_app_data(m_context, this);
+        SSL_CTX_set_session_cache_mode(m_context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(m_context, &CachingSSLWrapper::onNewSession);
+    }
+
+    SSL_CTX_up_ref(m_context);
+    return m_context;
+}
+
+bool CachingSSLWrapper::useCertificate(SSL_CTX* context, X509* certificate)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (context == m_context && certificate == m_contextCertificate) {
+        return true;
+    }
+
+    const bool result = SSLWrapper::useCertificate(context, certificate);
+    if (result && context == m_context) {
+        m_contextCertificate = certificate;
+    }
+    return result;
+}
+
+bool CachingSSLWrapper::usePrivateKey(SSL_CTX* context, EVP_PKEY* privateKey)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (context == m_context && privateKey == m_contextPrivateKey) {
+        return true;
+    }
+
+    const bool result = SSLWrapper::usePrivateKey(context, privateKey);
+    if (result && context == m_context) {
+        m_contextPrivateKey = privateKey;
+    }
+    return result;
+}
+
+SSL* CachingSSLWrapper::createInstance(SSL_CTX* context)
+{
+    SSL* ssl = SSLWrapper::createInstance(context);
+    if (ssl == nullptr) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_session != nullptr && SSL_SESSION_is_resumable(m_session)) {
+        // The phone falls back to a full handshake if it no longer knows the session
+        SSL_set_session(ssl, m_session);
+    }
+    return ssl;
+}
+
+int CachingSSLWrapper::doHandshake(SSL* ssl)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_handshakeStarted.emplace(ssl, std::chrono::steady_clock::now());
+    }
+
+    const int result = SSLWrapper::doHandshake(ssl);
+    if (!SSL_is_init_finished(ssl)) {
+        return result;
+    }
+
+    HandshakeListener listener;
+    std::chrono::microseconds duration(0);
+    const bool resumed = SSL_session_reused(ssl) == 1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_handshakeStarted.find(ssl);
+        if (it == m_handshakeStarted.end()) {
+            return result;
+        }
+
+        duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - it->second);
+        m_handshakeStarted.erase(it);
+        listener = m_handshakeListener;
+    }
+
+    ++m_handshakeCount;
+    if (resumed) {
+        ++m_resumedCount;
+    }
+    m_lastHandshakeUs = duration.count();
+
+    qDebug() << "TLS handshake completed in" << duration.count() / 1000.0 << "ms" << (resumed ? "(resumed)" : "(full)");
+    if (listener) {
+        listener(duration, resumed);
+    }
+    return result;
+}
+
+void CachingSSLWrapper::free(SSL* ssl)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_handshakeStarted.erase(ssl);
+    }
+    SSLWrapper::free(ssl);
+}
+
+int CachingSSLWrapper::onNewSession(SSL* ssl, SSL_SESSION* session)
+{
+    // Called for TLS 1.2 sessions at the end of the handshake and for every
+    // TLS 1.3 ticket the phone sends afterwards
+    auto self = static_cast<CachingSSLWrapper*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+    if (self == nullptr) {
+        return 0;
+    }
+
+    self->storeSession(session);
+    return 1;
+}
+
+void CachingSSLWrapper::storeSession(SSL_SESSION* session)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_session != nullptr) {
+        SSL_SESSION_free(m_session);
+    }
+    // Ownership was handed over by returning 1 from the callback
+    m_session = session;
+}
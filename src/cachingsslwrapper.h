@@ -0,0 +1,73 @@
+#ifndef CACHINGSSLWRAPPER_H
+#define CACHINGSSLWRAPPER_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <aasdk/Transport/SSLWrapper.hpp>
+
+// Process-wide SSL wrapper shared by every session's Cryptor.
+//
+// aasdk's Cryptor parses the head unit certificate and key and builds a new
+// SSL_CTX on every init(). This wrapper hands out reference-counted copies of
+// objects created once, keeps the last session the phone issued and offers it
+// for resumption on the next connection. Handshake durations are measured
+// from the first doHandshake() call on an SSL object to its completion.
+class CachingSSLWrapper : public aasdk::transport::SSLWrapper,
+                          public std::enable_shared_from_this<CachingSSLWrapper>
+{
+public:
+    typedef std::shared_ptr<CachingSSLWrapper> Pointer;
+    typedef std::function<void(std::chrono::microseconds duration, bool resumed)> HandshakeListener;
+
+    CachingSSLWrapper();
+    ~CachingSSLWrapper() override;
+
+    // Builds the context and parses certificate and key through a throwaway
+    // Cryptor so the first real connection finds everything cached
+    void preload();
+
+    void setHandshakeListener(HandshakeListener listener);
+    void forgetSession();
+
+    quint64 handshakeCount() const;
+    quint64 resumedCount() const;
+    qint64 lastHandshakeUs() const;
+
+    X509* readCertificate(const std::string& certificate) override;
+    EVP_PKEY* readPrivateKey(const std::string& privateKey) override;
+    SSL_CTX* createContext(const SSL_METHOD* method) override;
+    bool useCertificate(SSL_CTX* context, X509* certificate) override;
+    bool usePrivateKey(SSL_CTX* context, EVP_PKEY* privateKey) override;
+    SSL* createInstance(SSL_CTX* context) override;
+    int doHandshake(SSL* ssl) override;
+    void free(SSL* ssl) override;
+
+    using aasdk::transport::SSLWrapper::free;
+
+private:
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+    void storeSession(SSL_SESSION* session);
+
+    std::mutex m_mutex;
+    std::map<std::string, X509*> m_certificates;
+    std::map<std::string, EVP_PKEY*> m_privateKeys;
+    SSL_CTX* m_context;
+    X509* m_contextCertificate;
+    EVP_PKEY* m_contextPrivateKey;
+    SSL_SESSION* m_session;
+    std::map<SSL*, std::chrono::steady_clock::time_point> m_handshakeStarted;
+    HandshakeListener m_handshakeListener;
+
+    std::atomic<quint64> m_handshakeCount;
+    std::atomic<quint64> m_resumedCount;
+    std::atomic<qint64> m_lastHandshakeUs;
+};
+
+#endif // CACHINGSSLWRAPPER_H
@@ -0,0 +1,66 @@
+#ifndef CHANNELREGISTRY_H
+#define CHANNELREGISTRY_H
+
+#include <memory>
+#include <tuple>
+#include <utility>
+
+namespace aasdk {
+    namespace proto {
+        namespace messages {
+            class ServiceDiscoveryResponse;
+        }
+    }
+}
+
+// The services of one session, declared once as a type list. Start, stop and
+// the service discovery descriptors are generated from it, in declaration order.
+template<typename... Services>
+class ChannelRegistry
+{
+public:
+    explicit ChannelRegistry(std::shared_ptr<Services>... services)
+        : m_services(std::move(services)...)
+    {
+    }
+
+    template<typename Service>
+    Service &get() const
+    {
+        return *std::get<std::shared_ptr<Service>>(m_services);
+    }
+
+    // Call on the strand
+    void start() const
+    {
+        forEach([](auto &service) { service->start(); });
+    }
+
+    void stop() const
+    {
+        forEach([](auto &service) { service->stop(); });
+    }
+
+    void fillFeatures(aasdk::proto::messages::ServiceDiscoveryResponse &response) const
+    {
+        forEach([&response](auto &service) { service->fillFeatures(response); });
+    }
+
+private:
+    template<typename Function>
+    void forEach(Function function) const
+    {
+        forEach(function, std::index_sequence_for<Services...>());
+    }
+
+    template<typename Function, std::size_t... Index>
+    void forEach(Function &function, std::index_sequence<Index...>) const
+    {
+        int expand[] = {0, (function(std::get<Index>(m_services)), 0)...};
+        (void)expand;
+    }
+
+    std::tuple<std::shared_ptr<Services>...> m_services;
+};
+
+#endif // CHANNELREGISTRY_H
@@ -0,0 +1,277 @@
+#include "controlservice.h"
+#include "sessionchannels.h"
+#include "flightrecorder.h"
+#include <QDebug>
+
+#include <aasdk_proto/ServiceDiscoveryRequestMessage.pb.h>
+#include <aasdk_proto/AudioFocusRequestMessage.pb.h>
+#include <aasdk_proto/AudioFocusResponseMessage.pb.h>
+#include <aasdk_proto/ShutdownRequestMessage.pb.h>
+#include <aasdk_proto/ShutdownResponseMessage.pb.h>
+#include <aasdk_proto/NavigationFocusRequestMessage.pb.h>
+#include <aasdk_proto/NavigationFocusResponseMessage.pb.h>
+#include <aasdk_proto/PingRequestMessage.pb.h>
+#include <aasdk_proto/PingResponseMessage.pb.h>
+#include <aasdk_proto/AuthCompleteIndicationMessage.pb.h>
+
+namespace {
+
+// Protocol version we speak
+const uint16_t cVersionMajor = 1;
+const uint16_t cVersionMinor = 1;
+
+// Round trip summary in the log about once a minute at the default interval
+const quint64 cLinkStatsEveryPings = 600;
+
+const char *linkStateName(LinkMonitor::State state)
+{
+    switch (state) {
+    case LinkMonitor::State::Healthy: return "healthy";
+    case LinkMonitor::State::Degraded: return "degraded";
+    case LinkMonitor::State::Dead: return "dead";
+    }
+    return "unknown";
+}
+
+}
+
+ControlService::ControlService(boost::asio::io_service::strand &strand,
+                               std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                               std::shared_ptr<aasdk::messenger::ICryptor> cryptor,
+                               std::shared_ptr<SessionChannels> channels,
+                               const LinkMonitor::Config &linkConfig,
+                               ShutdownHandler shutdownHandler,
+                               ErrorHandler errorHandler)
+    : ServiceChannel<ControlService>(strand, std::move(messenger), aasdk::messenger::ChannelId::CONTROL),
+      m_cryptor(std::move(cryptor)),
+      m_channels(std::move(channels)),
+      m_shutdownHandler(std::move(shutdownHandler)),
+      m_errorHandler(std::move(errorHandler)),
+      m_linkMonitor(linkConfig),
+      m_pingTimer(strand.get_io_service()),
+      m_linkMonitorStarted(false)
+{
+}
+
+void ControlService::start()
+{
+    startReceiving();
+
+    // Version exchange starts the TLS handshake
+    const aasdk::common::Data version = {
+        static_cast<uint8_t>(cVersionMajor >> 8), static_cast<uint8_t>(cVersionMajor & 0xff),
+        static_cast<uint8_t>(cVersionMinor >> 8), static_cast<uint8_t>(cVersionMinor & 0xff)
+    };
+    sendPlain(aasdk::proto::ids::ControlMessage::VERSION_REQUEST, version);
+}
+
+void ControlService::stop()
+{
+    stopReceiving();
+    m_pingTimer.cancel();
+}
+
+void ControlService::onVersionResponse(const VersionResponse& response)
+{
+    qDebug() << "Version response received:" << response.major << "." << response.minor;
+
+    if (response.status == aasdk::proto::enums::VersionResponseStatus::MISMATCH) {
+        qDebug() << "Version mismatch";
+        stopReceiving();
+        if (m_shutdownHandler) {
+            m_shutdownHandler("Android Auto protocol version mismatch");
+        }
+        return;
+    }
+
+    m_cryptor->doHandshake();
+    sendHandshake();
+}
+
+void ControlService::onHandshake(const aasdk::common::DataConstBuffer& payload)
+{
+    m_cryptor->writeHandshakeBuffer(payload);
+
+    if (!m_cryptor->doHandshake()) {
+        sendHandshake();
+    } else {
+        qDebug() << "TLS handshake finished, sending auth complete";
+
+        aasdk::proto::messages::AuthCompleteIndication indication;
+        indication.set_status(aasdk::proto::enums::Status::OK);
+        sendPlain(aasdk::proto::ids::ControlMessage::AUTH_COMPLETE, indication);
+    }
+}
+
+void ControlService::sendHandshake()
+{
+    sendPlain(aasdk::proto::ids::ControlMessage::SSL_HANDSHAKE, m_cryptor->readHandshakeBuffer());
+}
+
+void ControlService::onServiceDiscoveryRequest(const aasdk::proto::messages::ServiceDiscoveryRequest& request)
+{
+    qDebug() << "Service discovery request received";
+
+    aasdk::proto::messages::ServiceDiscoveryResponse response;
+    m_channels->fillFeatures(response);
+
+    // Advertised for the phone's benefit; no service handles these yet
+    response.add_channel_descriptors()->set_channel_id(static_cast<uint32_t>(aasdk::messenger::ChannelId::SENSOR));
+    response.add_channel_descriptors()->set_channel_id(static_cast<uint32_t>(aasdk::messenger::ChannelId::INPUT));
+
+    // The session is up once the phone has its channels; link monitoring starts there
+    send(aasdk::proto::ids::ControlMessage::SERVICE_DISCOVERY_RESPONSE, response,
+         [self = this->shared_from_this()]() {
+             self->m_strand.dispatch([self]() {
+                 self->startLinkMonitor();
+             });
+         });
+}
+
+void ControlService::onAudioFocusRequest(const aasdk::proto::messages::AudioFocusRequest& request)
+{
+    qDebug() << "Audio focus request received";
+
+    aasdk::proto::messages::AudioFocusResponse response;
+    response.set_audio_focus_state(aasdk::proto::enums::AudioFocusState::GAIN);
+    send(aasdk::proto::ids::ControlMessage::AUDIO_FOCUS_RESPONSE, response);
+}
+
+void ControlService::onShutdownRequest(const aasdk::proto::messages::ShutdownRequest& request)
+{
+    qDebug() << "Shutdown request received";
+
+    // Nothing more is read once the phone has asked to close
+    stopReceiving();
+
+    aasdk::proto::messages::ShutdownResponse response;
+    send(aasdk::proto::ids::ControlMessage::SHUTDOWN_RESPONSE, response,
+         [self = this->shared_from_this()]() {
+             if (self->m_shutdownHandler) {
+                 self->m_shutdownHandler(QString());
+             }
+         });
+}
+
+void ControlService::onShutdownResponse(const aasdk::proto::messages::ShutdownResponse& response)
+{
+    qDebug() << "Shutdown response received";
+    stopReceiving();
+
+    if (m_shutdownHandler) {
+        m_shutdownHandler(QString());
+    }
+}
+
+void ControlService::onNavigationFocusRequest(const aasdk::proto::messages::NavigationFocusRequest& request)
+{
+    qDebug() << "Navigation focus request received";
+
+    aasdk::proto::messages::NavigationFocusResponse response;
+    response.set_type(aasdk::proto::enums::NavigationFocusType::FOCUSED_NAVIGATION);
+    send(aasdk::proto::ids::ControlMessage::NAVIGATION_FOCUS_RESPONSE, response);
+}
+
+void ControlService::onPingRequest(const aasdk::proto::messages::PingRequest& request)
+{
+    qDebug() << "Ping request received";
+
+    aasdk::proto::messages::PingResponse response;
+    response.set_timestamp(request.timestamp());
+    send(aasdk::proto::ids::ControlMessage::PING_RESPONSE, response);
+}
+
+void ControlService::onPingResponse(const aasdk::proto::messages::PingResponse& response)
+{
+    if (!m_linkMonitor.pongReceived(response.timestamp(), LinkMonitor::Clock::now())) {
+        qDebug() << "Ping response for an unknown or expired ping";
+        return;
+    }
+
+    FlightRecorder::record(FlightEvent::LinkRtt, 0, static_cast<uint64_t>(m_linkMonitor.lastRtt().count()));
+}
+
+void ControlService::startLinkMonitor()
+{
+    if (m_linkMonitorStarted || isStopped() || m_linkMonitor.config().intervalMs <= 0) {
+        return;
+    }
+
+    m_linkMonitorStarted = true;
+    m_linkMonitor.start(LinkMonitor::Clock::now());
+    onPingTimer();
+}
+
+void ControlService::schedulePing()
+{
+    m_pingTimer.expires_from_now(std::chrono::milliseconds(m_linkMonitor.config().intervalMs));
+    m_pingTimer.async_wait([self = this->shared_from_this()](const boost::system::error_code &ec) {
+        self->m_strand.dispatch([self, ec]() {
+            if (!ec && !self->isStopped()) {
+                self->onPingTimer();
+            }
+        });
+    });
+}
+
+void ControlService::onPingTimer()
+{
+    const auto now = LinkMonitor::Clock::now();
+    const LinkMonitor::State previous = m_linkMonitor.state();
+    const LinkMonitor::State state = m_linkMonitor.evaluate(now);
+    if (state != previous) {
+        onLinkStateChanged(state);
+    }
+    if (state == LinkMonitor::State::Dead) {
+        return;
+    }
+
+    aasdk::proto::messages::PingRequest request;
+    request.set_timestamp(m_linkMonitor.pingSent(now));
+    send(aasdk::proto::ids::ControlMessage::PING_REQUEST, request);
+
+    if (m_linkMonitor.sent() % cLinkStatsEveryPings == 0) {
+        const RttHistogram &histogram = m_linkMonitor.histogram();
+        qDebug() << "Link round trip p50" << histogram.percentile(0.5).count() / 1000.0
+                 << "ms, p90" << histogram.percentile(0.9).count() / 1000.0
+                 << "ms, p99" << histogram.percentile(0.99).count() / 1000.0
+                 << "ms," << m_linkMonitor.lost() << "of" << m_linkMonitor.sent() << "pings lost";
+    }
+
+    schedulePing();
+}
+
+void ControlService::onLinkStateChanged(LinkMonitor::State state)
+{
+    FlightRecorder::record(FlightEvent::LinkState, 0, static_cast<uint64_t>(state), m_linkMonitor.lost());
+    qWarning() << "Link" << linkStateName(state) << ", last round trip"
+               << m_linkMonitor.lastRtt().count() / 1000.0 << "ms," << m_linkMonitor.lost() << "pings lost";
+
+    switch (state) {
+    case LinkMonitor::State::Healthy:
+        m_channels->get<VideoService>().setFrameRateLimit(0);
+        break;
+
+    case LinkMonitor::State::Degraded:
+        // Less video keeps the session usable where a teardown would blank the screen
+        m_channels->get<VideoService>().setFrameRateLimit(m_linkMonitor.config().degradedFps);
+        break;
+
+    case LinkMonitor::State::Dead:
+        // Faster than waiting for the transport to time out
+        stopReceiving();
+        if (m_shutdownHandler) {
+            m_shutdownHandler("The phone stopped responding");
+        }
+        break;
+    }
+}
+
+void ControlService::onChannelError(const aasdk::error::Error& e)
+{
+    qDebug() << "Control channel error:" << e.what();
+
+    if (m_errorHandler) {
+        m_errorHandler(e);
+    }
+}
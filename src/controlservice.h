@@ -0,0 +1,128 @@
+#ifndef CONTROLSERVICE_H
+#define CONTROLSERVICE_H
+
+#include <QString>
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+
+#include "linkmonitor.h"
+#include "servicechannel.h"
+
+#include <aasdk/Messenger/ICryptor.hpp>
+#include <aasdk_proto/ControlMessageIdsEnum.pb.h>
+#include <aasdk_proto/VersionResponseStatusEnum.pb.h>
+
+class SessionChannels;
+
+namespace aasdk {
+    namespace proto {
+        namespace messages {
+            class ServiceDiscoveryRequest;
+            class AudioFocusRequest;
+            class ShutdownRequest;
+            class ShutdownResponse;
+            class NavigationFocusRequest;
+            class PingRequest;
+            class PingResponse;
+        }
+    }
+}
+
+// Version response body: major, minor and status as big-endian 16-bit values
+struct VersionResponse
+{
+    uint16_t major;
+    uint16_t minor;
+    aasdk::proto::enums::VersionResponseStatus::Enum status;
+};
+
+template<>
+struct PayloadCodec<VersionResponse>
+{
+    static bool decode(const aasdk::common::DataConstBuffer &body, VersionResponse &payload)
+    {
+        if (body.size < 6) {
+            return false;
+        }
+        payload.major = static_cast<uint16_t>((body.cdata[0] << 8) | body.cdata[1]);
+        payload.minor = static_cast<uint16_t>((body.cdata[2] << 8) | body.cdata[3]);
+        payload.status = static_cast<aasdk::proto::enums::VersionResponseStatus::Enum>((body.cdata[4] << 8) | body.cdata[5]);
+        return true;
+    }
+};
+
+// Handles the CONTROL channel: version exchange, TLS handshake, service
+// discovery from the session's channel registry, focus and shutdown. Once
+// the session is up it pings the phone to watch link health, lowering the
+// video frame rate while the link is degraded and ending the session when
+// the phone stops answering.
+class ControlService : public ServiceChannel<ControlService>
+{
+public:
+    typedef std::function<void(const aasdk::error::Error&)> ErrorHandler;
+    // Called with an empty reason for an orderly shutdown
+    typedef std::function<void(const QString &reason)> ShutdownHandler;
+
+    ControlService(boost::asio::io_service::strand &strand,
+                   std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                   std::shared_ptr<aasdk::messenger::ICryptor> cryptor,
+                   std::shared_ptr<SessionChannels> channels,
+                   const LinkMonitor::Config &linkConfig,
+                   ShutdownHandler shutdownHandler,
+                   ErrorHandler errorHandler);
+
+    // Starts receiving and sends the version request that opens the session
+    void start();
+    void stop();
+
+    void onVersionResponse(const VersionResponse& response);
+    void onHandshake(const aasdk::common::DataConstBuffer& payload);
+    void onServiceDiscoveryRequest(const aasdk::proto::messages::ServiceDiscoveryRequest& request);
+    void onAudioFocusRequest(const aasdk::proto::messages::AudioFocusRequest& request);
+    void onShutdownRequest(const aasdk::proto::messages::ShutdownRequest& request);
+    void onShutdownResponse(const aasdk::proto::messages::ShutdownResponse& response);
+    void onNavigationFocusRequest(const aasdk::proto::messages::NavigationFocusRequest& request);
+    void onPingRequest(const aasdk::proto::messages::PingRequest& request);
+    void onPingResponse(const aasdk::proto::messages::PingResponse& response);
+    void onChannelError(const aasdk::error::Error& e);
+
+    typedef HandlerList<
+        On<ControlService, aasdk::proto::ids::ControlMessage::PING_REQUEST,
+           aasdk::proto::messages::PingRequest, &ControlService::onPingRequest>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::PING_RESPONSE,
+           aasdk::proto::messages::PingResponse, &ControlService::onPingResponse>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::VERSION_RESPONSE,
+           VersionResponse, &ControlService::onVersionResponse>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::SSL_HANDSHAKE,
+           aasdk::common::DataConstBuffer, &ControlService::onHandshake>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::SERVICE_DISCOVERY_REQUEST,
+           aasdk::proto::messages::ServiceDiscoveryRequest, &ControlService::onServiceDiscoveryRequest>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::AUDIO_FOCUS_REQUEST,
+           aasdk::proto::messages::AudioFocusRequest, &ControlService::onAudioFocusRequest>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::NAVIGATION_FOCUS_REQUEST,
+           aasdk::proto::messages::NavigationFocusRequest, &ControlService::onNavigationFocusRequest>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::SHUTDOWN_REQUEST,
+           aasdk::proto::messages::ShutdownRequest, &ControlService::onShutdownRequest>,
+        On<ControlService, aasdk::proto::ids::ControlMessage::SHUTDOWN_RESPONSE,
+           aasdk::proto::messages::ShutdownResponse, &ControlService::onShutdownResponse>
+    > Handlers;
+
+private:
+    void sendHandshake();
+    void startLinkMonitor();
+    void schedulePing();
+    void onPingTimer();
+    void onLinkStateChanged(LinkMonitor::State state);
+
+    std::shared_ptr<aasdk::messenger::ICryptor> m_cryptor;
+    std::shared_ptr<SessionChannels> m_channels;
+    ShutdownHandler m_shutdownHandler;
+    ErrorHandler m_errorHandler;
+
+    LinkMonitor m_linkMonitor;
+    boost::asio::steady_timer m_pingTimer;
+    bool m_linkMonitorStarted;
+};
+
+#endif // CONTROLSERVICE_H
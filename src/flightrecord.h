@@ -0,0 +1,131 @@
+#ifndef FLIGHTRECORD_H
+#define FLIGHTRECORD_H
+
+#include <cstdint>
+
+// On-disk layout of the flight recorder file, shared by FlightRecorder and
+// the aaqt_flight_dump tool. A 64-byte header is followed by a ring of
+// 64-byte records; bump cFlightVersion on any layout change.
+
+const char cFlightMagic[8] = {'A', 'A', 'Q', 'T', 'F', 'L', 'T', '1'};
+const uint32_t cFlightVersion = 1;
+
+enum class FlightEvent : uint16_t {
+    // Recorder opened; a = process id
+    Start = 1,
+    // Watchdog stage stuck in one unit of work; a = stage, b = ms so far
+    Stall,
+    // The same stage made progress again; a = stage, b = total ms
+    StallEnd,
+    // Session lifecycle; a = session generation
+    SessionStart,
+    SessionStop,
+    // Session stopped without draining in time; a = timeout ms
+    TeardownStalled,
+    // channel = channel id, a = message id, b = payload bytes
+    MessageIn,
+    MessageOut,
+    // Any error reaching a session; a = aasdk error code, b = native code
+    Error,
+    // text = device id or transport kind
+    UsbAttached,
+    UsbDetached,
+    // Access unit queued to the decoder; a = timestamp, b = bytes
+    FrameSubmitted,
+    // Access unit through the codec; a = timestamp, b = decode time in us
+    FrameDecoded,
+    // Frame handed to the surface on the GUI thread; a = timestamp
+    FramePresented,
+    // a = frames dropped so far
+    FrameDropped,
+    // a = overruns so far
+    AudioOverrun,
+    // Last record of a crashed process; a = signal number
+    Crash,
+    // Answered head unit ping; a = round trip in us
+    LinkRtt,
+    // Link health changed; a = 0 healthy, 1 degraded, 2 dead, b = lost pings so far
+    LinkState,
+    // Cold start milestone named in text; a = ms since main(), b = ms since boot
+    Milestone
+};
+
+enum class FlightStage : uint8_t {
+    Gui,
+    Io,
+    Decrypt,
+    Decode,
+    Count
+};
+
+struct FlightHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;
+    // CLOCK_REALTIME and CLOCK_MONOTONIC sampled together when the file was opened
+    int64_t wallClockNs;
+    int64_t monotonicNs;
+    int32_t pid;
+    uint32_t reserved[5];
+};
+
+struct FlightRecord
+{
+    // 1-based write sequence, 0 while the slot is being written
+    uint64_t sequence;
+    // CLOCK_MONOTONIC
+    int64_t timestampNs;
+    uint16_t event;
+    uint16_t channel;
+    // Kernel thread id
+    uint32_t thread;
+    uint64_t a;
+    uint64_t b;
+    char text[24];
+};
+
+static_assert(sizeof(FlightHeader) == 64, "FlightHeader layout changed");
+static_assert(sizeof(FlightRecord) == 64, "FlightRecord layout changed");
+
+inline const char *flightEventName(uint16_t event)
+{
+    switch (static_cast<FlightEvent>(event)) {
+    case FlightEvent::Start: return "start";
+    case FlightEvent::Stall: return "stall";
+    case FlightEvent::StallEnd: return "stall-end";
+    case FlightEvent::SessionStart: return "session-start";
+    case FlightEvent::SessionStop: return "session-stop";
+    case FlightEvent::TeardownStalled: return "teardown-stalled";
+    case FlightEvent::MessageIn: return "msg-in";
+    case FlightEvent::MessageOut: return "msg-out";
+    case FlightEvent::Error: return "error";
+    case FlightEvent::UsbAttached: return "usb-attached";
+    case FlightEvent::UsbDetached: return "usb-detached";
+    case FlightEvent::FrameSubmitted: return "frame-submitted";
+    case FlightEvent::FrameDecoded: return "frame-decoded";
+    case FlightEvent::FramePresented: return "frame-presented";
+    case FlightEvent::FrameDropped: return "frame-dropped";
+    case FlightEvent::AudioOverrun: return "audio-overrun";
+    case FlightEvent::Crash: return "crash";
+    case FlightEvent::LinkRtt: return "link-rtt";
+    case FlightEvent::LinkState: return "link-state";
+    case FlightEvent::Milestone: return "milestone";
+    }
+    return "unknown";
+}
+
+inline const char *flightStageName(uint64_t stage)
+{
+    switch (static_cast<FlightStage>(stage)) {
+    case FlightStage::Gui: return "gui";
+    case FlightStage::Io: return "io";
+    case FlightStage::Decrypt: return "decrypt";
+    case FlightStage::Decode: return "decode";
+    case FlightStage::Count: break;
+    }
+    return "unknown";
+}
+
+#endif // FLIGHTRECORD_H
@@ -0,0 +1,307 @@
+#include "flightrecorder.h"
+#include "threadpolicy.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<FlightRecorder*> s_instance(nullptr);
+
+// Zero-initialised so the lookup is safe inside a signal handler
+thread_local uint32_t t_thread = 0;
+
+const int cFatalSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+int64_t clockNs(clockid_t clock)
+{
+    timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+int64_t monotonicNs()
+{
+    return clockNs(CLOCK_MONOTONIC);
+}
+
+uint32_t currentThread()
+{
+    if (t_thread == 0) {
+        t_thread = static_cast<uint32_t>(syscall(SYS_gettid));
+    }
+    return t_thread;
+}
+
+void onFatalSignal(int signal)
+{
+    FlightRecorder::record(FlightEvent::Crash, 0, static_cast<uint64_t>(signal));
+    // SA_RESETHAND put the default action back, so this dumps core as usual
+    raise(signal);
+}
+
+}
+
+FlightRecorder::Config FlightRecorder::Config::fromSettings(QSettings &settings)
+{
+    Config config;
+    settings.beginGroup("recorder");
+    config.enabled = settings.value("enabled", config.enabled).toBool();
+    config.path = settings.value("path", config.path).toString();
+    config.records = settings.value("records", config.records).toInt();
+    config.stallMs = settings.value("stallMs", config.stallMs).toInt();
+    settings.endGroup();
+    return config;
+}
+
+FlightRecorder::FlightRecorder(const Config &config)
+    : m_config(config),
+      m_fd(-1),
+      m_mapping(nullptr),
+      m_mappingSize(0),
+      m_records(nullptr),
+      m_mask(0),
+      m_next(0),
+      m_stopping(false)
+{
+    for (int i = 0; i < static_cast<int>(FlightStage::Count); ++i) {
+        m_busySince[i] = 0;
+        m_stalled[i] = false;
+    }
+
+    if (!m_config.enabled || !open()) {
+        return;
+    }
+
+    s_instance = this;
+    installCrashHandler();
+    record(FlightEvent::Start, 0, static_cast<uint64_t>(getpid()));
+
+    m_watchdog = std::thread(&FlightRecorder::watchdog, this);
+
+    qDebug() << "Flight recorder:" << m_path << "," << m_mask + 1 << "records";
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    if (m_mapping == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    if (m_watchdog.joinable()) {
+        m_watchdog.join();
+    }
+
+    s_instance = nullptr;
+
+    msync(m_mapping, m_mappingSize, MS_SYNC);
+    munmap(m_mapping, m_mappingSize);
+    ::close(m_fd);
+}
+
+bool FlightRecorder::isOpen() const
+{
+    return m_mapping != nullptr;
+}
+
+QString FlightRecorder::path() const
+{
+    return m_path;
+}
+
+void FlightRecorder::record(FlightEvent event, uint16_t channel, uint64_t a, uint64_t b, const char *text)
+{
+    FlightRecorder *recorder = s_instance.load(std::memory_order_acquire);
+    if (recorder != nullptr) {
+        recorder->append(event, channel, a, b, text);
+    }
+}
+
+void FlightRecorder::beginWork(FlightStage stage)
+{
+    FlightRecorder *recorder = s_instance.load(std::memory_order_acquire);
+    if (recorder != nullptr) {
+        recorder->m_busySince[static_cast<int>(stage)].store(monotonicNs(), std::memory_order_relaxed);
+    }
+}
+
+void FlightRecorder::endWork(FlightStage stage)
+{
+    FlightRecorder *recorder = s_instance.load(std::memory_order_acquire);
+    if (recorder == nullptr) {
+        return;
+    }
+
+    const int index = static_cast<int>(stage);
+    const int64_t since = recorder->m_busySince[index].exchange(0, std::memory_order_relaxed);
+    if (recorder->m_stalled[index].load(std::memory_order_relaxed) && recorder->m_stalled[index].exchange(false)) {
+        const int64_t stalledMs = since != 0 ? (monotonicNs() - since) / 1000000 : 0;
+        recorder->append(FlightEvent::StallEnd, 0, static_cast<uint64_t>(index), static_cast<uint64_t>(stalledMs), nullptr);
+    }
+}
+
+void FlightRecorder::watchLoop(FlightStage stage, Poster poster)
+{
+    FlightRecorder *recorder = s_instance.load(std::memory_order_acquire);
+    if (recorder == nullptr) {
+        return;
+    }
+
+    const int index = static_cast<int>(stage);
+    std::lock_guard<std::mutex> lock(recorder->m_mutex);
+    recorder->m_posters[index] = std::move(poster);
+    // A probe still queued on a loop that goes away never runs
+    recorder->m_busySince[index] = 0;
+    recorder->m_stalled[index] = false;
+}
+
+bool FlightRecorder::open()
+{
+    m_path = m_config.path;
+    if (m_path.isEmpty()) {
+        const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+        QDir().mkpath(directory);
+        m_path = directory + "/flight.rec";
+    }
+
+    // Keep the previous run; after a crash and restart that is the one worth reading
+    const QByteArray fileName = QFile::encodeName(m_path);
+    ::rename(fileName.constData(), (fileName + ".1").constData());
+
+    m_fd = ::open(fileName.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        qWarning() << "Flight recorder: cannot create" << m_path << ":" << strerror(errno);
+        return false;
+    }
+
+    uint64_t capacity = 64;
+    while (capacity < static_cast<uint64_t>(std::max(m_config.records, 0))) {
+        capacity <<= 1;
+    }
+    const size_t size = sizeof(FlightHeader) + capacity * sizeof(FlightRecord);
+
+    // Blocks are allocated up front so a full disk cannot turn a record into SIGBUS
+    const int rc = posix_fallocate(m_fd, 0, static_cast<off_t>(size));
+    void *mapping = rc == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, 0)
+                            : MAP_FAILED;
+    if (mapping == MAP_FAILED) {
+        qWarning() << "Flight recorder: cannot map" << m_path << ":" << strerror(rc != 0 ? rc : errno);
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    FlightHeader *header = static_cast<FlightHeader*>(mapping);
+    std::memcpy(header->magic, cFlightMagic, sizeof(header->magic));
+    header->version = cFlightVersion;
+    header->recordSize = sizeof(FlightRecord);
+    header->capacity = capacity;
+    header->wallClockNs = clockNs(CLOCK_REALTIME);
+    header->monotonicNs = monotonicNs();
+    header->pid = getpid();
+
+    m_mapping = mapping;
+    m_mappingSize = size;
+    m_records = reinterpret_cast<FlightRecord*>(header + 1);
+    m_mask = capacity - 1;
+    return true;
+}
+
+void FlightRecorder::append(FlightEvent event, uint16_t channel, uint64_t a, uint64_t b, const char *text)
+{
+    const uint64_t sequence = m_next.fetch_add(1, std::memory_order_relaxed) + 1;
+    FlightRecord &slot = m_records[(sequence - 1) & m_mask];
+
+    // The sequence is cleared first and published last, so a slot torn by a
+    // crash or by a writer lapping the ring is recognised and skipped
+    __atomic_store_n(&slot.sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot.timestampNs = monotonicNs();
+    slot.event = static_cast<uint16_t>(event);
+    slot.channel = channel;
+    slot.thread = currentThread();
+    slot.a = a;
+    slot.b = b;
+    if (text != nullptr) {
+        std::strncpy(slot.text, text, sizeof(slot.text) - 1);
+        slot.text[sizeof(slot.text) - 1] = '\0';
+    } else {
+        slot.text[0] = '\0';
+    }
+    __atomic_store_n(&slot.sequence, sequence, __ATOMIC_RELEASE);
+}
+
+void FlightRecorder::watchdog()
+{
+    ThreadPolicy::apply("watchdog");
+
+    const auto tick = std::chrono::milliseconds(std::max(10, m_config.stallMs / 4));
+    const int64_t stallNs = static_cast<int64_t>(m_config.stallMs) * 1000000;
+    int64_t lastSync = monotonicNs();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        m_condition.wait_for(lock, tick);
+        if (m_stopping) {
+            break;
+        }
+
+        const int64_t now = monotonicNs();
+        for (int i = 0; i < static_cast<int>(FlightStage::Count); ++i) {
+            const int64_t since = m_busySince[i].load(std::memory_order_relaxed);
+            if (since == 0) {
+                if (m_posters[i]) {
+                    // The loop counts as busy until the probe gets to run
+                    const FlightStage stage = static_cast<FlightStage>(i);
+                    m_busySince[i].store(now, std::memory_order_relaxed);
+                    m_posters[i]([stage]() {
+                        FlightRecorder::endWork(stage);
+                    });
+                }
+                continue;
+            }
+
+            if (now - since >= stallNs && !m_stalled[i].exchange(true)) {
+                const int64_t stalledMs = (now - since) / 1000000;
+                append(FlightEvent::Stall, 0, static_cast<uint64_t>(i), static_cast<uint64_t>(stalledMs), nullptr);
+                qWarning() << "Stage" << flightStageName(i) << "stalled for" << stalledMs << "ms";
+            }
+        }
+
+        // A crash loses nothing, the page cache outlives the process; this
+        // bounds what a power cut can take
+        if (now - lastSync >= 1000000000) {
+            msync(m_mapping, m_mappingSize, MS_ASYNC);
+            lastSync = now;
+        }
+    }
+}
+
+void FlightRecorder::installCrashHandler()
+{
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onFatalSignal;
+    action.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+
+    for (int signal : cFatalSignals) {
+        sigaction(signal, &action, nullptr);
+    }
+}
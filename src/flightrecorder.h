@@ -0,0 +1,88 @@
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "flightrecord.h"
+
+class QSettings;
+
+// Always-on flight recorder. Events are written as fixed-size records into a
+// memory-mapped ring file, so the last few seconds before a stall, a
+// disconnect or a crash are on disk without anyone having to reproduce them.
+// Decode the file with aaqt_flight_dump.
+//
+// One recorder serves the process. It is created early in main() and must be
+// destroyed after every thread that records has stopped; while none exists
+// record() does nothing.
+class FlightRecorder
+{
+public:
+    struct Config
+    {
+        bool enabled = true;
+        // Empty picks flight.rec in the application data directory
+        QString path;
+        // Rounded up to a power of two; 64 bytes each
+        int records = 65536;
+        // A stage stuck in one unit of work for this long is recorded as a stall
+        int stallMs = 200;
+
+        static Config fromSettings(QSettings &settings);
+    };
+
+    // Queues a function on an event loop; used to probe loops that cannot report themselves
+    typedef std::function<void(std::function<void()>)> Poster;
+
+    explicit FlightRecorder(const Config &config);
+    ~FlightRecorder();
+
+    bool isOpen() const;
+    QString path() const;
+
+    // Lock-free and syscall-free; safe from any thread and from signal handlers
+    static void record(FlightEvent event, uint16_t channel = 0, uint64_t a = 0, uint64_t b = 0,
+                       const char *text = nullptr);
+
+    // Brackets one unit of work on a worker stage for the stall watchdog
+    static void beginWork(FlightStage stage);
+    static void endWork(FlightStage stage);
+
+    // The watchdog posts a probe through poster every tick and reports a stall
+    // when it does not run in time. Pass nullptr before the loop goes away.
+    static void watchLoop(FlightStage stage, Poster poster);
+
+private:
+    bool open();
+    void append(FlightEvent event, uint16_t channel, uint64_t a, uint64_t b, const char *text);
+    void watchdog();
+    void installCrashHandler();
+
+    const Config m_config;
+    QString m_path;
+    int m_fd;
+    void *m_mapping;
+    size_t m_mappingSize;
+    FlightRecord *m_records;
+    uint64_t m_mask;
+    std::atomic<uint64_t> m_next;
+
+    // Monotonic start of the stage's current unit of work, 0 while idle
+    std::atomic<int64_t> m_busySince[static_cast<int>(FlightStage::Count)];
+    // Set by the watchdog once a stall of the current unit has been recorded
+    std::atomic<bool> m_stalled[static_cast<int>(FlightStage::Count)];
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    Poster m_posters[static_cast<int>(FlightStage::Count)];
+    bool m_stopping;
+    std::thread m_watchdog;
+};
+
+#endif // FLIGHTRECORDER_H
@@ -0,0 +1,101 @@
+#include "frameconverter.h"
+#include <QDebug>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+static AVPixelFormat toAVPixelFormat(QVideoFrame::PixelFormat format)
+{
+    switch (format) {
+    case QVideoFrame::Format_RGB32:
+    case QVideoFrame::Format_ARGB32:
+    case QVideoFrame::Format_ARGB32_Premultiplied:
+        // Native-endian 0xAARRGGBB, the same layout Qt uses
+        return AV_PIX_FMT_RGB32;
+    case QVideoFrame::Format_YUV420P:
+        return AV_PIX_FMT_YUV420P;
+    default:
+        return AV_PIX_FMT_NONE;
+    }
+}
+
+FrameConverter::FrameConverter()
+    : m_swsContext(nullptr)
+{
+}
+
+FrameConverter::~FrameConverter()
+{
+    sws_freeContext(m_swsContext);
+}
+
+bool FrameConverter::convert(const AVFrame *src, QVideoFrame &dst)
+{
+    const AVPixelFormat dstFormat = toAVPixelFormat(dst.pixelFormat());
+    if (dstFormat == AV_PIX_FMT_NONE) {
+        return false;
+    }
+
+    const bool sameSize = src->width == dst.width() && src->height == dst.height();
+    if (sameSize && dstFormat == AV_PIX_FMT_YUV420P
+            && (src->format == AV_PIX_FMT_YUV420P || src->format == AV_PIX_FMT_YUVJ420P)) {
+        return copyPlanes(src, dst);
+    }
+
+    m_swsContext = sws_getCachedContext(m_swsContext,
+                                        src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                        dst.width(), dst.height(), dstFormat,
+                                        SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+    if (m_swsContext == nullptr) {
+        qWarning() << "Unable to create scaler for" << src->width << "x" << src->height;
+        return false;
+    }
+
+    if (!dst.map(QAbstractVideoBuffer::WriteOnly)) {
+        return false;
+    }
+
+    uint8_t *dstData[4] = {};
+    int dstStride[4] = {};
+    for (int plane = 0; plane < dst.planeCount(); ++plane) {
+        dstData[plane] = dst.bits(plane);
+        dstStride[plane] = dst.bytesPerLine(plane);
+    }
+
+    sws_scale(m_swsContext, src->data, src->linesize, 0, src->height, dstData, dstStride);
+    dst.unmap();
+    return true;
+}
+
+bool FrameConverter::copyPlanes(const AVFrame *src, QVideoFrame &dst)
+{
+    if (!dst.map(QAbstractVideoBuffer::WriteOnly)) {
+        return false;
+    }
+
+    for (int plane = 0; plane < 3; ++plane) {
+        const int rows = plane == 0 ? src->height : (src->height + 1) / 2;
+        const int rowBytes = plane == 0 ? src->width : (src->width + 1) / 2;
+        const int dstStride = dst.bytesPerLine(plane);
+        const uint8_t *in = src->data[plane];
+        uchar *out = dst.bits(plane);
+
+        if (dstStride == src->linesize[plane]) {
+            std::memcpy(out, in, static_cast<size_t>(dstStride) * rows);
+            continue;
+        }
+
+        for (int row = 0; row < rows; ++row) {
+            std::memcpy(out, in, rowBytes);
+            in += src->linesize[plane];
+            out += dstStride;
+        }
+    }
+
+    dst.unmap();
+    return true;
+}
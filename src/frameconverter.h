@@ -0,0 +1,30 @@
+#ifndef FRAMECONVERTER_H
+#define FRAMECONVERTER_H
+
+#include <QVideoFrame>
+
+struct AVFrame;
+struct SwsContext;
+
+// Converts decoded frames into the pixel format and size the video surface
+// was started with. YUV420P at the native size is copied plane by plane,
+// everything else goes through libswscale.
+class FrameConverter
+{
+public:
+    FrameConverter();
+    ~FrameConverter();
+
+    FrameConverter(const FrameConverter &) = delete;
+    FrameConverter &operator=(const FrameConverter &) = delete;
+
+    // dst must be a writable, unmapped frame
+    bool convert(const AVFrame *src, QVideoFrame &dst);
+
+private:
+    bool copyPlanes(const AVFrame *src, QVideoFrame &dst);
+
+    SwsContext *m_swsContext;
+};
+
+#endif // FRAMECONVERTER_H
@@ -0,0 +1,134 @@
+#include "framepool.h"
+#include <QAbstractVideoBuffer>
+
+class PooledVideoBuffer : public QAbstractVideoBuffer
+{
+public:
+    PooledVideoBuffer(std::shared_ptr<VideoFramePool> pool, std::vector<uchar> &&buffer, int bytesPerLine)
+        : QAbstractVideoBuffer(QAbstractVideoBuffer::NoHandle),
+          m_pool(std::move(pool)),
+          m_buffer(std::move(buffer)),
+          m_bytesPerLine(bytesPerLine),
+          m_mapMode(NotMapped)
+    {
+    }
+
+    ~PooledVideoBuffer() override
+    {
+        m_pool->release(std::move(m_buffer));
+    }
+
+    MapMode mapMode() const override
+    {
+        return m_mapMode;
+    }
+
+    uchar *map(MapMode mode, int *numBytes, int *bytesPerLine) override
+    {
+        if (m_mapMode != NotMapped || mode == NotMapped) {
+            return nullptr;
+        }
+
+        m_mapMode = mode;
+        if (numBytes) {
+            *numBytes = static_cast<int>(m_buffer.size());
+        }
+        if (bytesPerLine) {
+            *bytesPerLine = m_bytesPerLine;
+        }
+        return m_buffer.data();
+    }
+
+    void unmap() override
+    {
+        m_mapMode = NotMapped;
+    }
+
+private:
+    std::shared_ptr<VideoFramePool> m_pool;
+    std::vector<uchar> m_buffer;
+    int m_bytesPerLine;
+    MapMode m_mapMode;
+};
+
+std::shared_ptr<VideoFramePool> VideoFramePool::create(int capacity)
+{
+    return std::shared_ptr<VideoFramePool>(new VideoFramePool(capacity));
+}
+
+VideoFramePool::VideoFramePool(int capacity)
+    : m_capacity(capacity), m_inFlight(0)
+{
+    m_free.reserve(capacity);
+}
+
+QVideoFrame VideoFramePool::acquire(const QSize &size, QVideoFrame::PixelFormat format)
+{
+    const int bytes = frameBytes(size, format);
+    if (bytes <= 0) {
+        return QVideoFrame();
+    }
+
+    std::vector<uchar> buffer;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_inFlight >= m_capacity) {
+            return QVideoFrame();
+        }
+
+        if (!m_free.empty()) {
+            buffer = std::move(m_free.back());
+            m_free.pop_back();
+        }
+        ++m_inFlight;
+    }
+
+    // Only reallocates when the stream resolution or pixel format changes
+    buffer.resize(bytes);
+
+    auto videoBuffer = new PooledVideoBuffer(shared_from_this(), std::move(buffer), bytesPerLine(size, format));
+    return QVideoFrame(videoBuffer, size, format);
+}
+
+void VideoFramePool::release(std::vector<uchar> &&buffer)
+{
+    QMutexLocker locker(&m_mutex);
+    --m_inFlight;
+    m_free.push_back(std::move(buffer));
+}
+
+int VideoFramePool::capacity() const
+{
+    return m_capacity;
+}
+
+int VideoFramePool::available() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_capacity - m_inFlight;
+}
+
+int VideoFramePool::bytesPerLine(const QSize &size, QVideoFrame::PixelFormat format)
+{
+    switch (format) {
+    case QVideoFrame::Format_RGB32:
+    case QVideoFrame::Format_ARGB32:
+    case QVideoFrame::Format_ARGB32_Premultiplied:
+        return size.width() * 4;
+    case QVideoFrame::Format_YUV420P:
+        // Chroma planes use half of this stride, so keep it even
+        return (size.width() + 1) & ~1;
+    default:
+        return 0;
+    }
+}
+
+int VideoFramePool::frameBytes(const QSize &size, QVideoFrame::PixelFormat format)
+{
+    const int stride = bytesPerLine(size, format);
+    if (format == QVideoFrame::Format_YUV420P) {
+        const int chromaHeight = (size.height() + 1) / 2;
+        return stride * size.height() + 2 * (stride / 2) * chromaHeight;
+    }
+    return stride * size.height();
+}
@@ -0,0 +1,40 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QVideoFrame>
+#include <QMutex>
+#include <QSize>
+#include <memory>
+#include <vector>
+
+// Recycles the byte buffers behind decoded QVideoFrames so the decode thread
+// does not go through the allocator for every frame it produces.
+class VideoFramePool : public std::enable_shared_from_this<VideoFramePool>
+{
+public:
+    static std::shared_ptr<VideoFramePool> create(int capacity);
+
+    // Returns a writable frame backed by a pooled buffer. The buffer goes back
+    // to the pool once the last QVideoFrame referring to it is destroyed.
+    // Returns an invalid frame when every buffer is still in flight.
+    QVideoFrame acquire(const QSize &size, QVideoFrame::PixelFormat format);
+
+    int capacity() const;
+    int available() const;
+
+    static int bytesPerLine(const QSize &size, QVideoFrame::PixelFormat format);
+    static int frameBytes(const QSize &size, QVideoFrame::PixelFormat format);
+
+private:
+    explicit VideoFramePool(int capacity);
+    void release(std::vector<uchar> &&buffer);
+
+    friend class PooledVideoBuffer;
+
+    mutable QMutex m_mutex;
+    std::vector<std::vector<uchar>> m_free;
+    int m_capacity;
+    int m_inFlight;
+};
+
+#endif // FRAMEPOOL_H
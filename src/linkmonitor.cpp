@@ -0,0 +1,199 @@
+#include "linkmonitor.h"
+#include <QSettings>
+#include <algorithm>
+
+namespace {
+
+const int64_t cFirstBucketUs = 250;
+
+}
+
+void RttHistogram::add(std::chrono::microseconds rtt)
+{
+    int bucket = 0;
+    int64_t bound = cFirstBucketUs;
+    while (bucket < cBuckets - 1 && rtt.count() > bound) {
+        ++bucket;
+        bound *= 2;
+    }
+    ++m_buckets[bucket];
+    ++m_count;
+}
+
+void RttHistogram::clear()
+{
+    m_buckets.fill(0);
+    m_count = 0;
+}
+
+quint64 RttHistogram::count() const
+{
+    return m_count;
+}
+
+std::chrono::microseconds RttHistogram::percentile(double fraction) const
+{
+    if (m_count == 0) {
+        return std::chrono::microseconds(0);
+    }
+
+    const quint64 wanted = std::max<quint64>(1, static_cast<quint64>(fraction * m_count + 0.5));
+    quint64 seen = 0;
+    int64_t bound = cFirstBucketUs;
+    for (int bucket = 0; bucket < cBuckets; ++bucket, bound *= 2) {
+        seen += m_buckets[bucket];
+        if (seen >= wanted) {
+            break;
+        }
+    }
+    return std::chrono::microseconds(bound);
+}
+
+LinkMonitor::Config LinkMonitor::Config::fromSettings(QSettings &settings)
+{
+    Config config;
+    settings.beginGroup("link");
+    config.intervalMs = settings.value("pingIntervalMs", config.intervalMs).toInt();
+    config.timeoutMs = settings.value("pingTimeoutMs", config.timeoutMs).toInt();
+    config.deadAfterMs = settings.value("deadAfterMs", config.deadAfterMs).toInt();
+    config.degradedRttMs = settings.value("degradedRttMs", config.degradedRttMs).toInt();
+    config.degradedLoss = settings.value("degradedLoss", config.degradedLoss).toInt();
+    config.windowPings = std::max(1, settings.value("windowPings", config.windowPings).toInt());
+    config.degradeAfterWindows = settings.value("degradeAfterWindows", config.degradeAfterWindows).toInt();
+    config.recoverAfterWindows = settings.value("recoverAfterWindows", config.recoverAfterWindows).toInt();
+    config.degradedFps = settings.value("degradedFps", config.degradedFps).toInt();
+    settings.endGroup();
+    return config;
+}
+
+LinkMonitor::LinkMonitor(const Config &config)
+    : m_config(config),
+      m_state(State::Healthy),
+      m_lastRtt(0),
+      m_sent(0),
+      m_lost(0),
+      m_windowSent(0),
+      m_windowLost(0),
+      m_badWindows(0),
+      m_goodWindows(0)
+{
+    m_windowRtts.reserve(m_config.windowPings);
+}
+
+const LinkMonitor::Config &LinkMonitor::config() const
+{
+    return m_config;
+}
+
+void LinkMonitor::start(Clock::time_point now)
+{
+    m_lastAnswer = now;
+    m_lastEvaluate = now;
+}
+
+int64_t LinkMonitor::pingSent(Clock::time_point now)
+{
+    const int64_t timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    m_outstanding.push_back({timestamp, now});
+    ++m_sent;
+    ++m_windowSent;
+    return timestamp;
+}
+
+bool LinkMonitor::pongReceived(int64_t timestamp, Clock::time_point now)
+{
+    auto it = std::find_if(m_outstanding.begin(), m_outstanding.end(), [timestamp](const Outstanding &ping) {
+        return ping.timestamp == timestamp;
+    });
+    if (it == m_outstanding.end()) {
+        return false;
+    }
+
+    m_lastRtt = std::chrono::duration_cast<std::chrono::microseconds>(now - it->sentAt);
+    m_outstanding.erase(it);
+    m_lastAnswer = now;
+    m_histogram.add(m_lastRtt);
+    m_windowRtts.push_back(m_lastRtt);
+    return true;
+}
+
+LinkMonitor::State LinkMonitor::evaluate(Clock::time_point now)
+{
+    if (m_state == State::Dead) {
+        return m_state;
+    }
+
+    // A late tick means this side stalled; answers may still be queued behind it
+    const bool lateTick = now - m_lastEvaluate > std::chrono::milliseconds(m_config.intervalMs * 2);
+    m_lastEvaluate = now;
+
+    const auto timeout = std::chrono::milliseconds(m_config.timeoutMs);
+    while (!m_outstanding.empty() && now - m_outstanding.front().sentAt >= timeout) {
+        m_outstanding.pop_front();
+        ++m_lost;
+        ++m_windowLost;
+    }
+
+    if (!lateTick && now - m_lastAnswer >= std::chrono::milliseconds(m_config.deadAfterMs)) {
+        m_state = State::Dead;
+        return m_state;
+    }
+
+    if (m_windowSent >= m_config.windowPings) {
+        closeWindow();
+    }
+    return m_state;
+}
+
+void LinkMonitor::closeWindow()
+{
+    std::chrono::microseconds p90(0);
+    if (!m_windowRtts.empty()) {
+        const size_t index = std::min(m_windowRtts.size() - 1, m_windowRtts.size() * 9 / 10);
+        std::nth_element(m_windowRtts.begin(), m_windowRtts.begin() + index, m_windowRtts.end());
+        p90 = m_windowRtts[index];
+    }
+
+    const bool bad = m_windowLost >= m_config.degradedLoss
+        || p90 > std::chrono::milliseconds(m_config.degradedRttMs);
+    if (bad) {
+        m_goodWindows = 0;
+        if (++m_badWindows >= m_config.degradeAfterWindows) {
+            m_state = State::Degraded;
+        }
+    } else {
+        m_badWindows = 0;
+        if (++m_goodWindows >= m_config.recoverAfterWindows) {
+            m_state = State::Healthy;
+        }
+    }
+
+    m_windowRtts.clear();
+    m_windowSent = 0;
+    m_windowLost = 0;
+}
+
+LinkMonitor::State LinkMonitor::state() const
+{
+    return m_state;
+}
+
+std::chrono::microseconds LinkMonitor::lastRtt() const
+{
+    return m_lastRtt;
+}
+
+const RttHistogram &LinkMonitor::histogram() const
+{
+    return m_histogram;
+}
+
+quint64 LinkMonitor::sent() const
+{
+    return m_sent;
+}
+
+quint64 LinkMonitor::lost() const
+{
+    return m_lost;
+}
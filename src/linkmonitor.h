@@ -0,0 +1,111 @@
+#ifndef LINKMONITOR_H
+#define LINKMONITOR_H
+
+#include <QtGlobal>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class QSettings;
+
+// Ping round trip times in power-of-two buckets with upper bounds from 250 us
+// to 2.048 s; the last bucket also takes anything slower
+class RttHistogram
+{
+public:
+    static const int cBuckets = 14;
+
+    void add(std::chrono::microseconds rtt);
+    void clear();
+    quint64 count() const;
+    // Upper bound of the bucket holding the given fraction of samples
+    std::chrono::microseconds percentile(double fraction) const;
+
+private:
+    std::array<quint64, cBuckets> m_buckets = {};
+    quint64 m_count = 0;
+};
+
+// Link health from the head unit's own pings. Pings are sent at a fixed
+// interval; a ping without an answer after timeoutMs counts as lost, and no
+// answer at all for deadAfterMs means the link is dead. Loss or round trips
+// above degradedRttMs over whole windows of pings move the link to Degraded;
+// it recovers after a run of clean windows. Not thread-safe; used on the strand.
+class LinkMonitor
+{
+public:
+    enum class State {
+        Healthy,
+        Degraded,
+        Dead
+    };
+
+    struct Config
+    {
+        int intervalMs = 100;
+        int timeoutMs = 250;
+        int deadAfterMs = 500;
+        // 90th percentile round trip that makes a window bad
+        int degradedRttMs = 60;
+        // Lost pings that make a window bad
+        int degradedLoss = 2;
+        int windowPings = 20;
+        int degradeAfterWindows = 2;
+        int recoverAfterWindows = 3;
+        // Video frame rate asked of the phone while degraded
+        int degradedFps = 20;
+
+        static Config fromSettings(QSettings &settings);
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    explicit LinkMonitor(const Config &config);
+
+    const Config &config() const;
+
+    // Starts the dead-link clock
+    void start(Clock::time_point now);
+    // Returns the timestamp to carry in the ping request
+    int64_t pingSent(Clock::time_point now);
+    // False for a timestamp that was never sent or has already timed out
+    bool pongReceived(int64_t timestamp, Clock::time_point now);
+    // Expires unanswered pings and closes finished windows; call before each ping
+    State evaluate(Clock::time_point now);
+
+    State state() const;
+    std::chrono::microseconds lastRtt() const;
+    const RttHistogram &histogram() const;
+    quint64 sent() const;
+    quint64 lost() const;
+
+private:
+    struct Outstanding
+    {
+        int64_t timestamp;
+        Clock::time_point sentAt;
+    };
+
+    void closeWindow();
+
+    const Config m_config;
+    State m_state;
+    std::deque<Outstanding> m_outstanding;
+    Clock::time_point m_lastAnswer;
+    Clock::time_point m_lastEvaluate;
+    std::chrono::microseconds m_lastRtt;
+    RttHistogram m_histogram;
+    quint64 m_sent;
+    quint64 m_lost;
+
+    // Current window
+    std::vector<std::chrono::microseconds> m_windowRtts;
+    int m_windowSent;
+    int m_windowLost;
+    int m_badWindows;
+    int m_goodWindows;
+};
+
+#endif // LINKMONITOR_H
@@ -0,0 +1,154 @@
+#include "navigationservice.h"
+#include "navigationstate.h"
+#include <QDebug>
+#include <QSettings>
+
+#include <aasdk_proto/ChannelOpenRequestMessage.pb.h>
+#include <aasdk_proto/ChannelOpenResponseMessage.pb.h>
+#include <aasdk_proto/NavigationStatusMessage.pb.h>
+#include <aasdk_proto/NavigationTurnEventMessage.pb.h>
+#include <aasdk_proto/NavigationDistanceEventMessage.pb.h>
+
+namespace {
+
+QString maneuverName(aasdk::proto::enums::ManeuverType::Enum type)
+{
+    using aasdk::proto::enums::ManeuverType;
+
+    switch (type) {
+    case ManeuverType::DEPART: return QStringLiteral("depart");
+    case ManeuverType::NAME_CHANGE: return QStringLiteral("name-change");
+    case ManeuverType::SLIGHT_TURN: return QStringLiteral("slight-turn");
+    case ManeuverType::TURN: return QStringLiteral("turn");
+    case ManeuverType::SHARP_TURN: return QStringLiteral("sharp-turn");
+    case ManeuverType::U_TURN: return QStringLiteral("u-turn");
+    case ManeuverType::ON_RAMP: return QStringLiteral("on-ramp");
+    case ManeuverType::OFF_RAMP: return QStringLiteral("off-ramp");
+    case ManeuverType::FORK: return QStringLiteral("fork");
+    case ManeuverType::MERGE: return QStringLiteral("merge");
+    case ManeuverType::ROUNDABOUT_ENTER: return QStringLiteral("roundabout-enter");
+    case ManeuverType::ROUNDABOUT_EXIT: return QStringLiteral("roundabout-exit");
+    case ManeuverType::ROUNDABOUT_ENTER_AND_EXIT: return QStringLiteral("roundabout");
+    case ManeuverType::STRAIGHT: return QStringLiteral("straight");
+    case ManeuverType::FERRY_BOAT: return QStringLiteral("ferry");
+    case ManeuverType::FERRY_TRAIN: return QStringLiteral("ferry-train");
+    case ManeuverType::DESTINATION: return QStringLiteral("destination");
+    default: return QStringLiteral("unknown");
+    }
+}
+
+QString sideName(aasdk::proto::enums::ManeuverDirection::Enum side)
+{
+    switch (side) {
+    case aasdk::proto::enums::ManeuverDirection::LEFT: return QStringLiteral("left");
+    case aasdk::proto::enums::ManeuverDirection::RIGHT: return QStringLiteral("right");
+    default: return QString();
+    }
+}
+
+// The phone sends the display value in thousandths of the unit it wants shown
+QString distanceText(int displayMillis, aasdk::proto::enums::DistanceUnit::Enum unit)
+{
+    using aasdk::proto::enums::DistanceUnit;
+    const double value = displayMillis / 1000.0;
+
+    switch (unit) {
+    case DistanceUnit::METERS: return QStringLiteral("%1 m").arg(qRound(value));
+    case DistanceUnit::KILOMETERS: return QStringLiteral("%1 km").arg(qRound(value));
+    case DistanceUnit::KILOMETERS_PARTIAL: return QStringLiteral("%1 km").arg(value, 0, 'f', 1);
+    case DistanceUnit::MILES: return QStringLiteral("%1 mi").arg(qRound(value));
+    case DistanceUnit::MILES_PARTIAL: return QStringLiteral("%1 mi").arg(value, 0, 'f', 1);
+    case DistanceUnit::FEET: return QStringLiteral("%1 ft").arg(qRound(value));
+    case DistanceUnit::YARDS: return QStringLiteral("%1 yd").arg(qRound(value));
+    default: return QString();
+    }
+}
+
+}
+
+NavigationService::NavigationService(boost::asio::io_service::strand &strand,
+                                     std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                                     NavigationState &state,
+                                     ErrorHandler errorHandler)
+    : ServiceChannel<NavigationService>(strand, std::move(messenger), aasdk::messenger::ChannelId::NAVIGATION),
+      m_state(state),
+      m_errorHandler(std::move(errorHandler))
+{
+}
+
+void NavigationService::start()
+{
+    startReceiving();
+}
+
+void NavigationService::stop()
+{
+    // The next session starts from a blank banner
+    stopReceiving();
+    m_state.clear();
+}
+
+void NavigationService::fillFeatures(aasdk::proto::messages::ServiceDiscoveryResponse &response)
+{
+    QSettings settings;
+
+    // Maneuvers as enums rather than turn images, which we do not render
+    auto navigationChannel = addDescriptor(response)->mutable_navigation_channel();
+    navigationChannel->set_minimum_interval_ms(settings.value("navigation/minimumIntervalMs", 500).toInt());
+    navigationChannel->set_type(aasdk::proto::enums::NavigationTurnType::ENUM);
+
+    auto imageOptions = navigationChannel->mutable_image_options();
+    imageOptions->set_width(256);
+    imageOptions->set_height(256);
+    imageOptions->set_colour_depth_bits(16);
+    imageOptions->set_dunno(256);
+}
+
+void NavigationService::onChannelOpenRequest(const aasdk::proto::messages::ChannelOpenRequest& request)
+{
+    qDebug() << "Navigation channel open request, priority" << request.priority();
+
+    aasdk::proto::messages::ChannelOpenResponse response;
+    response.set_status(aasdk::proto::enums::Status::OK);
+    sendControl(aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_RESPONSE, response);
+}
+
+void NavigationService::onStatusUpdate(const aasdk::proto::messages::NavigationStatus& status)
+{
+    qDebug() << "Navigation status" << status.status();
+
+    // Rerouting keeps the last maneuver on screen until the new route arrives
+    const bool active = status.status() == aasdk::proto::messages::NavigationStatus::ACTIVE
+                        || status.status() == aasdk::proto::messages::NavigationStatus::REROUTING;
+    if (active) {
+        m_state.setActive(true);
+    } else {
+        m_state.clear();
+    }
+}
+
+void NavigationService::onTurnEvent(const aasdk::proto::messages::NavigationTurnEvent& event)
+{
+    m_state.setTurn(QString::fromStdString(event.street_name()),
+                    maneuverName(event.maneuver_type()),
+                    sideName(event.maneuver_side()),
+                    event.roundabout_exit_number());
+}
+
+void NavigationService::onDistanceEvent(const aasdk::proto::messages::NavigationDistanceEvent& event)
+{
+    // Arrives several times a second; NavigationState coalesces it for the GUI thread
+    m_state.setDistance(static_cast<int>(event.meters()),
+                        distanceText(static_cast<int>(event.distance_to_step_millis()), event.distance_unit()),
+                        static_cast<int>(event.time_to_step_seconds()));
+}
+
+void NavigationService::onChannelError(const aasdk::error::Error& e)
+{
+    qDebug() << "Navigation channel error:" << e.what();
+    m_state.clear();
+
+    if (m_errorHandler) {
+        m_errorHandler(e);
+    }
+}
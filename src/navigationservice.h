@@ -0,0 +1,63 @@
+#ifndef NAVIGATIONSERVICE_H
+#define NAVIGATIONSERVICE_H
+
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+
+#include "servicechannel.h"
+
+#include <aasdk_proto/ControlMessageIdsEnum.pb.h>
+#include <aasdk_proto/NavigationChannelMessageIdsEnum.pb.h>
+
+class NavigationState;
+
+namespace aasdk {
+    namespace proto {
+        namespace messages {
+            class ChannelOpenRequest;
+            class NavigationStatus;
+            class NavigationTurnEvent;
+            class NavigationDistanceEvent;
+        }
+    }
+}
+
+// Handles the NAVIGATION channel and keeps NavigationState current for QML
+class NavigationService : public ServiceChannel<NavigationService>
+{
+public:
+    typedef std::function<void(const aasdk::error::Error&)> ErrorHandler;
+
+    NavigationService(boost::asio::io_service::strand &strand,
+                      std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                      NavigationState &state,
+                      ErrorHandler errorHandler);
+
+    void start();
+    void stop();
+    void fillFeatures(aasdk::proto::messages::ServiceDiscoveryResponse &response);
+
+    void onChannelOpenRequest(const aasdk::proto::messages::ChannelOpenRequest& request);
+    void onStatusUpdate(const aasdk::proto::messages::NavigationStatus& status);
+    void onTurnEvent(const aasdk::proto::messages::NavigationTurnEvent& event);
+    void onDistanceEvent(const aasdk::proto::messages::NavigationDistanceEvent& event);
+    void onChannelError(const aasdk::error::Error& e);
+
+    typedef HandlerList<
+        On<NavigationService, aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_REQUEST,
+           aasdk::proto::messages::ChannelOpenRequest, &NavigationService::onChannelOpenRequest>,
+        On<NavigationService, aasdk::proto::ids::NavigationChannelMessage::DISTANCE_EVENT,
+           aasdk::proto::messages::NavigationDistanceEvent, &NavigationService::onDistanceEvent>,
+        On<NavigationService, aasdk::proto::ids::NavigationChannelMessage::TURN_EVENT,
+           aasdk::proto::messages::NavigationTurnEvent, &NavigationService::onTurnEvent>,
+        On<NavigationService, aasdk::proto::ids::NavigationChannelMessage::STATUS,
+           aasdk::proto::messages::NavigationStatus, &NavigationService::onStatusUpdate>
+    > Handlers;
+
+private:
+    NavigationState &m_state;
+    ErrorHandler m_errorHandler;
+};
+
+#endif // NAVIGATIONSERVICE_H
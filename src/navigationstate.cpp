@@ -0,0 +1,167 @@
+#include "navigationstate.h"
+#include <QSettings>
+
+NavigationState::NavigationState(QObject *parent)
+    : QObject(parent),
+      m_publishScheduled(false),
+      m_publishedUpdates(0)
+{
+    // One publish per display frame at most, however fast distance updates arrive
+    QSettings settings;
+    m_publishTimer.setInterval(settings.value("navigation/coalesceMs", 16).toInt());
+    m_publishTimer.setSingleShot(true);
+    m_publishTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_publishTimer, &QTimer::timeout, this, &NavigationState::publish);
+}
+
+bool NavigationState::isActive() const
+{
+    return m_published.active;
+}
+
+QString NavigationState::street() const
+{
+    return m_published.street;
+}
+
+QString NavigationState::maneuver() const
+{
+    return m_published.maneuver;
+}
+
+QString NavigationState::side() const
+{
+    return m_published.side;
+}
+
+int NavigationState::roundaboutExit() const
+{
+    return m_published.roundaboutExit;
+}
+
+int NavigationState::distanceMeters() const
+{
+    return m_published.distanceMeters;
+}
+
+QString NavigationState::distanceText() const
+{
+    return m_published.distanceText;
+}
+
+int NavigationState::timeToStepSeconds() const
+{
+    return m_published.timeToStepSeconds;
+}
+
+void NavigationState::setActive(bool active)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.active = active;
+    }
+    schedulePublish();
+}
+
+void NavigationState::setTurn(const QString &street, const QString &maneuver, const QString &side, int roundaboutExit)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.street = street;
+        m_pending.maneuver = maneuver;
+        m_pending.side = side;
+        m_pending.roundaboutExit = roundaboutExit;
+    }
+    schedulePublish();
+}
+
+void NavigationState::setDistance(int meters, const QString &text, int timeToStepSeconds)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.distanceMeters = meters;
+        m_pending.distanceText = text;
+        m_pending.timeToStepSeconds = timeToStepSeconds;
+    }
+    schedulePublish();
+}
+
+void NavigationState::clear()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending = State();
+    }
+    schedulePublish();
+}
+
+quint64 NavigationState::publishedUpdates() const
+{
+    return m_publishedUpdates;
+}
+
+void NavigationState::schedulePublish()
+{
+    // Only the first change in an interval crosses to the GUI thread
+    if (m_publishScheduled.exchange(true)) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, [this]() {
+        if (!m_publishTimer.isActive()) {
+            m_publishTimer.start();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void NavigationState::publish()
+{
+    State next;
+    {
+        QMutexLocker locker(&m_mutex);
+        next = m_pending;
+        m_publishScheduled = false;
+    }
+
+    // Swap in the whole state before notifying so bindings never see a mix of old and new
+    const State previous = m_published;
+    m_published = next;
+
+    bool changed = false;
+    if (previous.active != next.active) {
+        emit activeChanged();
+        changed = true;
+    }
+    if (previous.street != next.street) {
+        emit streetChanged();
+        changed = true;
+    }
+    if (previous.maneuver != next.maneuver) {
+        emit maneuverChanged();
+        changed = true;
+    }
+    if (previous.side != next.side) {
+        emit sideChanged();
+        changed = true;
+    }
+    if (previous.roundaboutExit != next.roundaboutExit) {
+        emit roundaboutExitChanged();
+        changed = true;
+    }
+    if (previous.distanceMeters != next.distanceMeters) {
+        emit distanceMetersChanged();
+        changed = true;
+    }
+    if (previous.distanceText != next.distanceText) {
+        emit distanceTextChanged();
+        changed = true;
+    }
+    if (previous.timeToStepSeconds != next.timeToStepSeconds) {
+        emit timeToStepSecondsChanged();
+        changed = true;
+    }
+
+    if (changed) {
+        ++m_publishedUpdates;
+    }
+}
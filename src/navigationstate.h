@@ -0,0 +1,85 @@
+#ifndef NAVIGATIONSTATE_H
+#define NAVIGATIONSTATE_H
+
+#include <QObject>
+#include <QMutex>
+#include <QString>
+#include <QTimer>
+#include <atomic>
+
+// Current turn-by-turn state for QML. The navigation channel updates it from
+// the io thread; changes are applied on the GUI thread at most once per
+// coalescing interval and only properties that actually changed notify.
+class NavigationState : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool active READ isActive NOTIFY activeChanged)
+    Q_PROPERTY(QString street READ street NOTIFY streetChanged)
+    Q_PROPERTY(QString maneuver READ maneuver NOTIFY maneuverChanged)
+    Q_PROPERTY(QString side READ side NOTIFY sideChanged)
+    Q_PROPERTY(int roundaboutExit READ roundaboutExit NOTIFY roundaboutExitChanged)
+    Q_PROPERTY(int distanceMeters READ distanceMeters NOTIFY distanceMetersChanged)
+    Q_PROPERTY(QString distanceText READ distanceText NOTIFY distanceTextChanged)
+    Q_PROPERTY(int timeToStepSeconds READ timeToStepSeconds NOTIFY timeToStepSecondsChanged)
+
+public:
+    explicit NavigationState(QObject *parent = nullptr);
+
+    bool isActive() const;
+    QString street() const;
+    QString maneuver() const;
+    QString side() const;
+    int roundaboutExit() const;
+    int distanceMeters() const;
+    QString distanceText() const;
+    int timeToStepSeconds() const;
+
+    // Thread safe; called from the navigation channel
+    void setActive(bool active);
+    void setTurn(const QString &street, const QString &maneuver, const QString &side, int roundaboutExit);
+    void setDistance(int meters, const QString &text, int timeToStepSeconds);
+    void clear();
+
+    // Updates published to QML since startup, for the stress harness and logs
+    quint64 publishedUpdates() const;
+
+signals:
+    void activeChanged();
+    void streetChanged();
+    void maneuverChanged();
+    void sideChanged();
+    void roundaboutExitChanged();
+    void distanceMetersChanged();
+    void distanceTextChanged();
+    void timeToStepSecondsChanged();
+
+private slots:
+    void publish();
+
+private:
+    struct State
+    {
+        bool active = false;
+        QString street;
+        QString maneuver;
+        QString side;
+        int roundaboutExit = 0;
+        int distanceMeters = 0;
+        QString distanceText;
+        int timeToStepSeconds = 0;
+    };
+
+    void schedulePublish();
+
+    // Written by the io thread under m_mutex
+    State m_pending;
+    QMutex m_mutex;
+    std::atomic<bool> m_publishScheduled;
+
+    // Read by QML on the GUI thread
+    State m_published;
+    QTimer m_publishTimer;
+    quint64 m_publishedUpdates;
+};
+
+#endif // NAVIGATIONSTATE_H
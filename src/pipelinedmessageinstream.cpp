@@ -0,0 +1,344 @@
+#include "pipelinedmessageinstream.h"
+#include "flightrecorder.h"
+#include "threadpolicy.h"
+#include <QDebug>
+#include <algorithm>
+#include <iterator>
+
+#include <aasdk/Messenger/FrameSize.hpp>
+#include <aasdk/IO/Promise.hpp>
+
+namespace {
+
+// Zero or negative values from the settings file would stall the pipeline for good
+PipelinedMessageInStream::Config clamped(PipelinedMessageInStream::Config config)
+{
+    config.readAhead = std::max(1, config.readAhead);
+    config.batchSize = std::max(1, config.batchSize);
+    return config;
+}
+
+}
+
+PipelinedMessageInStream::PipelinedMessageInStream(boost::asio::io_service &ioService,
+                                                   aasdk::transport::ITransport::Pointer transport,
+                                                   aasdk::messenger::ICryptor::Pointer cryptor,
+                                                   const Config &config)
+    : m_strand(ioService),
+      m_transport(std::move(transport)),
+      m_cryptor(std::move(cryptor)),
+      m_config(clamped(config)),
+      m_reading(false),
+      m_failed(false),
+      m_recordsInFlight(0),
+      m_stopping(false),
+      m_recordCount(0),
+      m_batchCount(0)
+{
+    m_records.reserve(m_config.readAhead);
+    m_batch.reserve(m_config.batchSize);
+
+    m_worker = std::thread([this]() {
+        decryptLoop();
+    });
+}
+
+PipelinedMessageInStream::~PipelinedMessageInStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+}
+
+void PipelinedMessageInStream::startReceive(aasdk::messenger::ReceivePromise::Pointer promise)
+{
+    m_strand.dispatch([this, self = this->shared_from_this(), promise = std::move(promise)]() mutable {
+        if (m_promise != nullptr) {
+            promise->reject(aasdk::error::Error(aasdk::error::ErrorCode::OPERATION_IN_PROGRESS));
+            return;
+        }
+
+        m_promise = std::move(promise);
+        resolvePending();
+    });
+}
+
+void PipelinedMessageInStream::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_records.clear();
+    }
+    m_condition.notify_all();
+
+    if (m_worker.joinable() && m_worker.get_id() != std::this_thread::get_id()) {
+        m_worker.join();
+    }
+
+    m_strand.dispatch([this, self = this->shared_from_this()]() {
+        fail(aasdk::error::Error(aasdk::error::ErrorCode::OPERATION_ABORTED));
+    });
+}
+
+quint64 PipelinedMessageInStream::recordCount() const
+{
+    return m_recordCount;
+}
+
+quint64 PipelinedMessageInStream::batchCount() const
+{
+    return m_batchCount;
+}
+
+void PipelinedMessageInStream::readFrameHeader()
+{
+    m_reading = true;
+
+    auto self = this->shared_from_this();
+    auto transportPromise = aasdk::io::PromisePtr<aasdk::common::Data>(
+        new aasdk::io::Promise<aasdk::common::Data>(
+            [this, self](aasdk::common::Data data) {
+                m_strand.dispatch([this, self, data = std::move(data)]() {
+                    onFrameHeader(data);
+                });
+            },
+            [this, self](const aasdk::error::Error &e) {
+                m_strand.dispatch([this, self, e]() {
+                    onTransportError(e);
+                });
+            }
+        )
+    );
+
+    m_transport->receive(aasdk::messenger::FrameHeader::getSizeOf(), transportPromise);
+}
+
+void PipelinedMessageInStream::onFrameHeader(const aasdk::common::Data &data)
+{
+    aasdk::messenger::FrameHeader header(aasdk::common::DataConstBuffer(data));
+
+    // Only the first frame of a multi-frame message carries the total size
+    const auto sizeType = header.getType() == aasdk::messenger::FrameType::FIRST
+            ? aasdk::messenger::FrameSizeType::EXTENDED
+            : aasdk::messenger::FrameSizeType::SHORT;
+
+    auto self = this->shared_from_this();
+    auto transportPromise = aasdk::io::PromisePtr<aasdk::common::Data>(
+        new aasdk::io::Promise<aasdk::common::Data>(
+            [this, self, header](aasdk::common::Data data) {
+                m_strand.dispatch([this, self, header, data = std::move(data)]() {
+                    onFrameSize(header, data);
+                });
+            },
+            [this, self](const aasdk::error::Error &e) {
+                m_strand.dispatch([this, self, e]() {
+                    onTransportError(e);
+                });
+            }
+        )
+    );
+
+    m_transport->receive(aasdk::messenger::FrameSize::getSizeOf(sizeType), transportPromise);
+}
+
+void PipelinedMessageInStream::onFrameSize(const aasdk::messenger::FrameHeader &header, const aasdk::common::Data &data)
+{
+    aasdk::messenger::FrameSize frameSize(aasdk::common::DataConstBuffer(data));
+
+    size_t totalSize = 0;
+    if (data.size() >= 6) {
+        totalSize = (static_cast<size_t>(data[2]) << 24) | (static_cast<size_t>(data[3]) << 16)
+                | (static_cast<size_t>(data[4]) << 8) | static_cast<size_t>(data[5]);
+    }
+
+    auto self = this->shared_from_this();
+    auto transportPromise = aasdk::io::PromisePtr<aasdk::common::Data>(
+        new aasdk::io::Promise<aasdk::common::Data>(
+            [this, self, header, totalSize](aasdk::common::Data body) {
+                m_strand.dispatch([this, self, header, totalSize, body = std::move(body)]() mutable {
+                    onFrameBody(header, totalSize, std::move(body));
+                });
+            },
+            [this, self](const aasdk::error::Error &e) {
+                m_strand.dispatch([this, self, e]() {
+                    onTransportError(e);
+                });
+            }
+        )
+    );
+
+    m_transport->receive(frameSize.getSize(), transportPromise);
+}
+
+void PipelinedMessageInStream::onFrameBody(const aasdk::messenger::FrameHeader &header, size_t totalSize,
+                                           aasdk::common::Data &&body)
+{
+    if (m_failed) {
+        m_reading = false;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_records.push_back(Record{header, std::move(body), totalSize});
+        m_weakSelf = this->shared_from_this();
+    }
+    m_condition.notify_one();
+    ++m_recordsInFlight;
+
+    // Keep the transport busy while the worker decrypts
+    if (canReadAhead()) {
+        readFrameHeader();
+    } else {
+        m_reading = false;
+    }
+}
+
+void PipelinedMessageInStream::onTransportError(const aasdk::error::Error &e)
+{
+    m_reading = false;
+    fail(e);
+}
+
+void PipelinedMessageInStream::decryptLoop()
+{
+    ThreadPolicy::apply("decrypt");
+
+    while (true) {
+        // shared_from_this() is not usable here while the destructor waits for us
+        std::weak_ptr<PipelinedMessageInStream> weakSelf;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() {
+                return m_stopping || !m_records.empty();
+            });
+
+            if (m_stopping) {
+                break;
+            }
+
+            const size_t count = std::min(m_records.size(), static_cast<size_t>(m_config.batchSize));
+            std::move(m_records.begin(), m_records.begin() + count, std::back_inserter(m_batch));
+            m_records.erase(m_records.begin(), m_records.begin() + count);
+            weakSelf = m_weakSelf;
+        }
+
+        std::vector<aasdk::messenger::Message::Pointer> completed;
+        completed.reserve(m_batch.size());
+
+        FlightRecorder::beginWork(FlightStage::Decrypt);
+        try {
+            for (Record &record : m_batch) {
+                decryptRecord(record, completed);
+            }
+        }
+        catch (const aasdk::error::Error &e) {
+            // A half assembled message would make every following FIRST frame look intertwined
+            m_assembling.reset();
+            m_strand.post([this, weakSelf, e]() {
+                if (auto self = weakSelf.lock()) {
+                    fail(e);
+                }
+            });
+        }
+
+        FlightRecorder::endWork(FlightStage::Decrypt);
+
+        const int processed = static_cast<int>(m_batch.size());
+        m_recordCount += processed;
+        ++m_batchCount;
+        m_batch.clear();
+
+        // One hand-off per batch rather than one per record
+        m_strand.post([this, weakSelf, completed = std::move(completed), processed]() mutable {
+            if (auto self = weakSelf.lock()) {
+                deliver(std::move(completed), processed);
+            }
+        });
+    }
+}
+
+void PipelinedMessageInStream::decryptRecord(Record &record, std::vector<aasdk::messenger::Message::Pointer> &completed)
+{
+    const aasdk::messenger::FrameType frameType = record.header.getType();
+
+    if (frameType == aasdk::messenger::FrameType::FIRST || frameType == aasdk::messenger::FrameType::BULK) {
+        if (m_assembling != nullptr) {
+            throw aasdk::error::Error(aasdk::error::ErrorCode::MESSENGER_INTERTWINED_CHANNELS);
+        }
+
+        m_assembling = std::make_shared<aasdk::messenger::Message>(record.header.getChannelId(),
+                                                                   record.header.getEncryptionType(),
+                                                                   record.header.getMessageType());
+        // Sized once from the announced total instead of growing frame by frame
+        m_assembling->getPayload().reserve(std::max(record.totalSize, record.body.size()));
+    } else if (m_assembling == nullptr || m_assembling->getChannelId() != record.header.getChannelId()) {
+        throw aasdk::error::Error(aasdk::error::ErrorCode::MESSENGER_INTERTWINED_CHANNELS);
+    }
+
+    if (record.header.getEncryptionType() == aasdk::messenger::EncryptionType::ENCRYPTED) {
+        m_cryptor->decrypt(m_assembling->getPayload(), aasdk::common::DataConstBuffer(record.body));
+    } else {
+        m_assembling->insertPayload(aasdk::common::DataConstBuffer(record.body));
+    }
+
+    if (frameType == aasdk::messenger::FrameType::LAST || frameType == aasdk::messenger::FrameType::BULK) {
+        completed.push_back(std::move(m_assembling));
+        m_assembling.reset();
+    }
+}
+
+void PipelinedMessageInStream::deliver(std::vector<aasdk::messenger::Message::Pointer> &&messages, int processedRecords)
+{
+    m_recordsInFlight -= processedRecords;
+
+    for (auto &message : messages) {
+        m_ready.push_back(std::move(message));
+    }
+
+    resolvePending();
+}
+
+void PipelinedMessageInStream::fail(const aasdk::error::Error &e)
+{
+    if (!m_failed) {
+        m_failed = true;
+        m_error = e;
+    }
+
+    resolvePending();
+}
+
+void PipelinedMessageInStream::resolvePending()
+{
+    if (m_promise != nullptr) {
+        if (!m_ready.empty()) {
+            auto promise = std::move(m_promise);
+            m_promise.reset();
+            auto message = std::move(m_ready.front());
+            m_ready.pop_front();
+            promise->resolve(std::move(message));
+        } else if (m_failed) {
+            auto promise = std::move(m_promise);
+            m_promise.reset();
+            promise->reject(m_error);
+        }
+    }
+
+    // Reading starts with the first receive and resumes once the consumer catches up
+    if (!m_reading && canReadAhead() && (m_promise != nullptr || !m_ready.empty() || m_recordsInFlight > 0)) {
+        readFrameHeader();
+    }
+}
+
+bool PipelinedMessageInStream::canReadAhead() const
+{
+    return !m_failed && static_cast<int>(m_ready.size()) + m_recordsInFlight < m_config.readAhead;
+}
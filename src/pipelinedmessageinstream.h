@@ -0,0 +1,113 @@
+#ifndef PIPELINEDMESSAGEINSTREAM_H
+#define PIPELINEDMESSAGEINSTREAM_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include <aasdk/Messenger/IMessageInStream.hpp>
+#include <aasdk/Messenger/ICryptor.hpp>
+#include <aasdk/Messenger/FrameHeader.hpp>
+#include <aasdk/Messenger/Message.hpp>
+#include <aasdk/Transport/ITransport.hpp>
+#include <aasdk/Error/Error.hpp>
+
+// Drop-in replacement for aasdk's MessageInStream that splits receiving into
+// three stages instead of doing everything inline on the io thread:
+//
+//   transport read (io strand) -> decrypt worker thread -> dispatch (io strand)
+//
+// Frames are read ahead while earlier ones are being decrypted. The worker
+// takes every record queued since it last woke up and decrypts them in one
+// pass, in arrival order as TLS requires, then hands the finished messages
+// back to the strand in a single post.
+class PipelinedMessageInStream : public aasdk::messenger::IMessageInStream,
+                                 public std::enable_shared_from_this<PipelinedMessageInStream>
+{
+public:
+    typedef std::shared_ptr<PipelinedMessageInStream> Pointer;
+
+    struct Config
+    {
+        // Messages decoded ahead of the messenger asking for them
+        int readAhead = 16;
+        // Records decrypted per worker wakeup at most
+        int batchSize = 16;
+    };
+
+    PipelinedMessageInStream(boost::asio::io_service &ioService,
+                             aasdk::transport::ITransport::Pointer transport,
+                             aasdk::messenger::ICryptor::Pointer cryptor,
+                             const Config &config = Config());
+    ~PipelinedMessageInStream() override;
+
+    void startReceive(aasdk::messenger::ReceivePromise::Pointer promise) override;
+    // Stops the decrypt worker; pending and future receives are rejected
+    void stop();
+
+    quint64 recordCount() const;
+    quint64 batchCount() const;
+
+private:
+    struct Record
+    {
+        aasdk::messenger::FrameHeader header;
+        aasdk::common::Data body;
+        // Total message size announced by a FIRST frame, 0 otherwise
+        size_t totalSize;
+    };
+
+    // Transport stage, runs on m_strand
+    void readFrameHeader();
+    void onFrameHeader(const aasdk::common::Data &data);
+    void onFrameSize(const aasdk::messenger::FrameHeader &header, const aasdk::common::Data &data);
+    void onFrameBody(const aasdk::messenger::FrameHeader &header, size_t totalSize, aasdk::common::Data &&body);
+    void onTransportError(const aasdk::error::Error &e);
+
+    // Decrypt stage, runs on m_worker
+    void decryptLoop();
+    void decryptRecord(Record &record, std::vector<aasdk::messenger::Message::Pointer> &completed);
+
+    // Dispatch stage, runs on m_strand
+    void deliver(std::vector<aasdk::messenger::Message::Pointer> &&messages, int processedRecords);
+    void fail(const aasdk::error::Error &e);
+    void resolvePending();
+    bool canReadAhead() const;
+
+    boost::asio::io_service::strand m_strand;
+    aasdk::transport::ITransport::Pointer m_transport;
+    aasdk::messenger::ICryptor::Pointer m_cryptor;
+    const Config m_config;
+
+    // Owned by the strand
+    aasdk::messenger::ReceivePromise::Pointer m_promise;
+    std::deque<aasdk::messenger::Message::Pointer> m_ready;
+    bool m_reading;
+    bool m_failed;
+    aasdk::error::Error m_error;
+    int m_recordsInFlight;
+
+    // Hand-off between the strand and the worker
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<Record> m_records;
+    std::weak_ptr<PipelinedMessageInStream> m_weakSelf;
+    bool m_stopping;
+
+    // Owned by the worker
+    aasdk::messenger::Message::Pointer m_assembling;
+    std::vector<Record> m_batch;
+
+    std::atomic<quint64> m_recordCount;
+    std::atomic<quint64> m_batchCount;
+
+    std::thread m_worker;
+};
+
+#endif // PIPELINEDMESSAGEINSTREAM_H
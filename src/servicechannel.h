@@ -0,0 +1,316 @@
+#ifndef SERVICECHANNEL_H
+#define SERVICECHANNEL_H
+
+#include <QDebug>
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+
+#include "flightrecorder.h"
+
+#include <aasdk/Common/Data.hpp>
+#include <aasdk/Messenger/IMessenger.hpp>
+#include <aasdk/Messenger/Message.hpp>
+#include <aasdk/Messenger/MessageId.hpp>
+#include <aasdk/Messenger/ChannelId.hpp>
+#include <aasdk/Messenger/Timestamp.hpp>
+#include <aasdk/IO/Promise.hpp>
+#include <aasdk/Error/Error.hpp>
+
+#include <aasdk_proto/ServiceDiscoveryResponseMessage.pb.h>
+#include <aasdk_proto/ChannelDescriptorData.pb.h>
+
+// Media payload that carries the capture timestamp ahead of the data
+struct TimestampedMedia
+{
+    aasdk::messenger::Timestamp::value_type timestamp;
+    aasdk::common::DataConstBuffer data;
+};
+
+// Turns message bodies into handler arguments and back. Protobuf messages
+// use the primary template; raw payloads are specialised below.
+template<typename Payload>
+struct PayloadCodec
+{
+    static bool decode(const aasdk::common::DataConstBuffer &body, Payload &payload)
+    {
+        return payload.ParseFromArray(body.cdata, static_cast<int>(body.size));
+    }
+
+    static void encode(const Payload &payload, aasdk::messenger::Message &message, aasdk::common::Data &scratch)
+    {
+        scratch.resize(payload.ByteSize());
+        payload.SerializeToArray(scratch.data(), static_cast<int>(scratch.size()));
+        message.insertPayload(scratch);
+    }
+};
+
+template<>
+struct PayloadCodec<aasdk::common::DataConstBuffer>
+{
+    static bool decode(const aasdk::common::DataConstBuffer &body, aasdk::common::DataConstBuffer &payload)
+    {
+        payload = body;
+        return true;
+    }
+
+    static void encode(const aasdk::common::DataConstBuffer &payload, aasdk::messenger::Message &message, aasdk::common::Data &)
+    {
+        message.insertPayload(payload);
+    }
+};
+
+template<>
+struct PayloadCodec<aasdk::common::Data>
+{
+    static void encode(const aasdk::common::Data &payload, aasdk::messenger::Message &message, aasdk::common::Data &)
+    {
+        message.insertPayload(payload);
+    }
+};
+
+template<>
+struct PayloadCodec<TimestampedMedia>
+{
+    static bool decode(const aasdk::common::DataConstBuffer &body, TimestampedMedia &payload)
+    {
+        if (body.size < aasdk::messenger::Timestamp::getSizeOf()) {
+            return false;
+        }
+        payload.timestamp = aasdk::messenger::Timestamp(body).getValue();
+        payload.data = aasdk::common::DataConstBuffer(body, aasdk::messenger::Timestamp::getSizeOf());
+        return true;
+    }
+
+    static void encode(const TimestampedMedia &payload, aasdk::messenger::Message &message, aasdk::common::Data &)
+    {
+        message.insertPayload(aasdk::messenger::Timestamp(payload.timestamp).getData());
+        message.insertPayload(payload.data);
+    }
+};
+
+// Binds one message id to a typed handler of Service
+template<typename Service, uint16_t Id, typename Payload, void (Service::*Handler)(const Payload&)>
+struct On
+{
+    static constexpr uint16_t id = Id;
+
+    static void invoke(Service &service, const aasdk::common::DataConstBuffer &body)
+    {
+        Payload payload;
+        if (!PayloadCodec<Payload>::decode(body, payload)) {
+            qWarning() << "Dropping malformed message" << Id << "on channel" << static_cast<int>(service.channelId());
+            return;
+        }
+        (service.*Handler)(payload);
+    }
+};
+
+template<typename... Handlers>
+struct HandlerList
+{
+};
+
+// Resolves a message id against a HandlerList at compile time; the chain of
+// constant comparisons inlines into the receive path with no virtual calls
+template<typename Service, typename List>
+struct Dispatch;
+
+template<typename Service>
+struct Dispatch<Service, HandlerList<>>
+{
+    static bool run(Service &, uint16_t, const aasdk::common::DataConstBuffer &)
+    {
+        return false;
+    }
+};
+
+template<typename Service, typename First, typename... Rest>
+struct Dispatch<Service, HandlerList<First, Rest...>>
+{
+    static bool run(Service &service, uint16_t id, const aasdk::common::DataConstBuffer &body)
+    {
+        if (id == First::id) {
+            First::invoke(service, body);
+            return true;
+        }
+        return Dispatch<Service, HandlerList<Rest...>>::run(service, id, body);
+    }
+};
+
+// Base for the services behind each channel. Derived declares
+//   typedef HandlerList<On<Derived, id, Payload, &Derived::handler>, ...> Handlers;
+//   void onChannelError(const aasdk::error::Error &e);
+// and gets typed dispatch, a receive that re-arms itself after every
+// message, and send helpers whose failures go to onChannelError().
+template<typename Derived>
+class ServiceChannel : public std::enable_shared_from_this<Derived>
+{
+public:
+    aasdk::messenger::ChannelId channelId() const
+    {
+        return m_channelId;
+    }
+
+protected:
+    ServiceChannel(boost::asio::io_service::strand &strand,
+                   std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                   aasdk::messenger::ChannelId channelId)
+        : m_strand(strand),
+          m_messenger(std::move(messenger)),
+          m_channelId(channelId),
+          m_stopped(false)
+    {
+    }
+
+    // Call on the strand
+    void startReceiving()
+    {
+        receive();
+    }
+
+    // Messages already queued on the strand are dropped and receive is not re-armed
+    void stopReceiving()
+    {
+        m_stopped = true;
+    }
+
+    bool isStopped() const
+    {
+        return m_stopped;
+    }
+
+    aasdk::proto::data::ChannelDescriptor *addDescriptor(aasdk::proto::messages::ServiceDiscoveryResponse &response) const
+    {
+        auto descriptor = response.add_channel_descriptors();
+        descriptor->set_channel_id(static_cast<uint32_t>(m_channelId));
+        return descriptor;
+    }
+
+    template<typename Payload>
+    void send(uint16_t messageId, const Payload &payload, std::function<void()> onSent = nullptr)
+    {
+        sendMessage(aasdk::messenger::EncryptionType::ENCRYPTED, aasdk::messenger::MessageType::SPECIFIC,
+                    messageId, payload, std::move(onSent));
+    }
+
+    // Channel-level messages such as the channel open response
+    template<typename Payload>
+    void sendControl(uint16_t messageId, const Payload &payload)
+    {
+        sendMessage(aasdk::messenger::EncryptionType::ENCRYPTED, aasdk::messenger::MessageType::CONTROL,
+                    messageId, payload, nullptr);
+    }
+
+    // Before TLS is up: version exchange and handshake records
+    template<typename Payload>
+    void sendPlain(uint16_t messageId, const Payload &payload)
+    {
+        sendMessage(aasdk::messenger::EncryptionType::PLAIN, aasdk::messenger::MessageType::SPECIFIC,
+                    messageId, payload, nullptr);
+    }
+
+    boost::asio::io_service::strand &m_strand;
+
+private:
+    Derived &derived()
+    {
+        return static_cast<Derived&>(*this);
+    }
+
+    void receive()
+    {
+        auto self = this->shared_from_this();
+        auto receivePromise = aasdk::io::PromisePtr<aasdk::messenger::Message::Pointer>(
+            new aasdk::io::Promise<aasdk::messenger::Message::Pointer>(
+                [self](aasdk::messenger::Message::Pointer message) {
+                    self->m_strand.dispatch([self, message]() {
+                        self->ServiceChannel<Derived>::onMessage(message);
+                    });
+                },
+                [self](const aasdk::error::Error &e) {
+                    self->m_strand.dispatch([self, e]() {
+                        // Receives are aborted when the session stops
+                        if (!self->ServiceChannel<Derived>::isStopped()) {
+                            self->onChannelError(e);
+                        }
+                    });
+                }
+            )
+        );
+
+        m_messenger->enqueueReceive(m_channelId, receivePromise);
+    }
+
+    void onMessage(const aasdk::messenger::Message::Pointer &message)
+    {
+        if (m_stopped) {
+            return;
+        }
+
+        const aasdk::common::Data &payload = message->getPayload();
+        if (payload.size() < aasdk::messenger::MessageId::getSizeOf()) {
+            qWarning() << "Dropping truncated message on channel" << static_cast<int>(m_channelId);
+        } else {
+            const aasdk::messenger::MessageId messageId(payload);
+            const aasdk::common::DataConstBuffer body(payload, aasdk::messenger::MessageId::getSizeOf());
+            FlightRecorder::record(FlightEvent::MessageIn, static_cast<uint16_t>(m_channelId),
+                                   messageId.getId(), body.size);
+
+            try {
+                if (!Dispatch<Derived, typename Derived::Handlers>::run(derived(), messageId.getId(), body)) {
+                    qDebug() << "Ignoring message" << messageId.getId() << "on channel" << static_cast<int>(m_channelId);
+                }
+            }
+            catch (const aasdk::error::Error &e) {
+                derived().onChannelError(e);
+                return;
+            }
+        }
+
+        // Re-armed here so no handler can forget it
+        if (!m_stopped) {
+            receive();
+        }
+    }
+
+    template<typename Payload>
+    void sendMessage(aasdk::messenger::EncryptionType encryption, aasdk::messenger::MessageType messageType,
+                     uint16_t messageId, const Payload &payload, std::function<void()> onSent)
+    {
+        auto message = std::make_shared<aasdk::messenger::Message>(m_channelId, encryption, messageType);
+        message->insertPayload(aasdk::messenger::MessageId(messageId).getData());
+        PayloadCodec<Payload>::encode(payload, *message, m_sendScratch);
+        FlightRecorder::record(FlightEvent::MessageOut, static_cast<uint16_t>(m_channelId),
+                               messageId, message->getPayload().size() - aasdk::messenger::MessageId::getSizeOf());
+
+        auto self = this->shared_from_this();
+        auto sendPromise = aasdk::io::PromisePtr<void>(
+            new aasdk::io::Promise<void>(
+                [onSent = std::move(onSent)]() {
+                    if (onSent) {
+                        onSent();
+                    }
+                },
+                [self](const aasdk::error::Error &e) {
+                    self->m_strand.dispatch([self, e]() {
+                        // Queued sends fail as well when the session stops
+                        if (!self->ServiceChannel<Derived>::isStopped()) {
+                            self->onChannelError(e);
+                        }
+                    });
+                }
+            )
+        );
+
+        m_messenger->enqueueSend(std::move(message), sendPromise);
+    }
+
+    std::shared_ptr<aasdk::messenger::IMessenger> m_messenger;
+    const aasdk::messenger::ChannelId m_channelId;
+    bool m_stopped;
+    // Serialisation buffer reused for every send; sends run on the strand
+    aasdk::common::Data m_sendScratch;
+};
+
+#endif // SERVICECHANNEL_H
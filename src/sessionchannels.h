@@ -0,0 +1,18 @@
+#ifndef SESSIONCHANNELS_H
+#define SESSIONCHANNELS_H
+
+#include "channelregistry.h"
+#include "videoservice.h"
+#include "avinputservice.h"
+#include "navigationservice.h"
+
+// Every service channel a session advertises. A new channel is added here
+// and constructed in AndroidAuto::startSession(); discovery, start and stop
+// pick it up from this list.
+class SessionChannels : public ChannelRegistry<VideoService, AVInputService, NavigationService>
+{
+public:
+    using ChannelRegistry::ChannelRegistry;
+};
+
+#endif // SESSIONCHANNELS_H
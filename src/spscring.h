@@ -0,0 +1,82 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed-capacity single-producer single-consumer ring of preallocated slots.
+// The producer fills a slot in place and publishes it, the consumer reads it
+// in place and releases it; neither side locks or allocates.
+template<typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity, const T &prototype = T())
+        : m_slots(capacity + 1, prototype),
+          m_head(0),
+          m_tail(0)
+    {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer side. Returns nullptr when the ring is full.
+    T *writeSlot()
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (next(head) == m_tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[head];
+    }
+
+    void publish()
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        m_head.store(next(head), std::memory_order_release);
+    }
+
+    // Consumer side. Returns nullptr when the ring is empty.
+    T *readSlot()
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[tail];
+    }
+
+    void release()
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_tail.store(next(tail), std::memory_order_release);
+    }
+
+    // Only exact when called from the consumer while the producer is idle
+    size_t size() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return head >= tail ? head - tail : head + m_slots.size() - tail;
+    }
+
+    size_t capacity() const
+    {
+        return m_slots.size() - 1;
+    }
+
+private:
+    size_t next(size_t index) const
+    {
+        return index + 1 == m_slots.size() ? 0 : index + 1;
+    }
+
+    std::vector<T> m_slots;
+    // Head and tail on separate cache lines so the two threads do not contend
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,80 @@
+#include "startuptimeline.h"
+#include "flightrecorder.h"
+#include <QDebug>
+#include <QFile>
+#include <ctime>
+#include <unistd.h>
+
+namespace {
+
+qint64 sinceBootMs()
+{
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return static_cast<qint64>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+// When the kernel started the process, in ms since boot; -1 if unknown
+qint64 processStartMs()
+{
+    QFile stat("/proc/self/stat");
+    if (!stat.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    // Fields follow the parenthesised name; starttime is field 22
+    const QByteArray line = stat.readAll();
+    const int nameEnd = line.lastIndexOf(')');
+    const QList<QByteArray> fields = line.mid(nameEnd + 2).split(' ');
+    if (nameEnd < 0 || fields.size() < 20) {
+        return -1;
+    }
+    return static_cast<qint64>(fields[19].toULongLong() * 1000 / sysconf(_SC_CLK_TCK));
+}
+
+}
+
+StartupTimeline::StartupTimeline(const QStringList &readyAfter)
+    : m_readyAfter(readyAfter)
+{
+    m_sinceMain.start();
+
+    // Dynamic linking and static constructors of Qt, FFmpeg and aasdk run before main()
+    const qint64 started = processStartMs();
+    const qint64 now = sinceBootMs();
+    if (started >= 0) {
+        qDebug() << "Startup: main() reached" << now - started << "ms after exec,"
+                 << now / 1000.0 << "s after boot";
+    }
+}
+
+void StartupTimeline::mark(const QString &milestone)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_marked.contains(milestone)) {
+        return;
+    }
+    log(milestone);
+
+    if (m_readyAfter.isEmpty()) {
+        return;
+    }
+    for (const QString &required : m_readyAfter) {
+        if (!m_marked.contains(required)) {
+            return;
+        }
+    }
+    m_readyAfter.clear();
+    log("ready-for-phone");
+}
+
+void StartupTimeline::log(const QString &milestone)
+{
+    m_marked.insert(milestone);
+
+    const qint64 sinceMain = m_sinceMain.elapsed();
+    const qint64 sinceBoot = sinceBootMs();
+    qDebug() << "Startup:" << milestone << "after" << sinceMain << "ms," << sinceBoot / 1000.0 << "s after boot";
+    FlightRecorder::record(FlightEvent::Milestone, 0, static_cast<uint64_t>(sinceMain),
+                           static_cast<uint64_t>(sinceBoot), milestone.toUtf8().constData());
+}
@@ -0,0 +1,31 @@
+#ifndef STARTUPTIMELINE_H
+#define STARTUPTIMELINE_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+// Cold start milestones. Each is logged once with the time since main() and
+// since the kernel booted; a head unit powers up with the ignition, so the
+// second is what the driver sits through. "ready-for-phone" follows by itself
+// once every milestone in readyAfter has been marked.
+class StartupTimeline
+{
+public:
+    explicit StartupTimeline(const QStringList &readyAfter);
+
+    // Thread-safe; marking a milestone again does nothing
+    void mark(const QString &milestone);
+
+private:
+    QMutex m_mutex;
+    QElapsedTimer m_sinceMain;
+    QSet<QString> m_marked;
+    QStringList m_readyAfter;
+
+    void log(const QString &milestone);
+};
+
+#endif // STARTUPTIMELINE_H
@@ -0,0 +1,244 @@
+#include "threadpolicy.h"
+#include <QDebug>
+#include <QFile>
+#include <QMutex>
+#include <QSettings>
+#include <QStringList>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+struct Registered
+{
+    QString name;
+    int thread;
+    quint64 lastTicks;
+    qint64 lastSampleNs;
+};
+
+QMutex s_mutex;
+std::vector<Registered> s_threads;
+
+qint64 monotonicNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<qint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// utime + stime of one of our threads in clock ticks
+bool readThreadTicks(int thread, quint64 &ticks)
+{
+    QFile stat(QString("/proc/self/task/%1/stat").arg(thread));
+    if (!stat.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    // The name is in parentheses and may contain spaces; fields follow the last ')'
+    const QByteArray line = stat.readAll();
+    const int nameEnd = line.lastIndexOf(')');
+    if (nameEnd < 0) {
+        return false;
+    }
+    const QList<QByteArray> fields = line.mid(nameEnd + 2).split(' ');
+    // Field 3 (state) comes first, utime and stime are fields 14 and 15
+    if (fields.size() < 13) {
+        return false;
+    }
+    ticks = fields[11].toULongLong() + fields[12].toULongLong();
+    return true;
+}
+
+QString describe(const ThreadPolicy::Policy &policy)
+{
+    QString text;
+    switch (policy.scheduler) {
+    case ThreadPolicy::Scheduler::Fifo:
+        text = QString("SCHED_FIFO %1").arg(policy.priority);
+        break;
+    case ThreadPolicy::Scheduler::RoundRobin:
+        text = QString("SCHED_RR %1").arg(policy.priority);
+        break;
+    case ThreadPolicy::Scheduler::Other:
+        text = QString("nice %1").arg(policy.nice);
+        break;
+    }
+
+    if (!policy.cpus.isEmpty()) {
+        QStringList cpus;
+        for (int cpu : policy.cpus) {
+            cpus.append(QString::number(cpu));
+        }
+        text += ", cpus " + cpus.join(',');
+    }
+    return text;
+}
+
+}
+
+ThreadPolicy::Policy ThreadPolicy::Policy::fromSettings(QSettings &settings, const QString &name, const Policy &defaults)
+{
+    Policy policy = defaults;
+
+    settings.beginGroup("threads/" + name);
+    if (settings.contains("cpus")) {
+        // Comma separated core list, e.g. "1,2,3"; QSettings may already have split it
+        policy.cpus.clear();
+        const QStringList cpus = settings.value("cpus").toStringList().join(',').split(',', Qt::SkipEmptyParts);
+        for (const QString &cpu : cpus) {
+            bool ok = false;
+            const int index = cpu.trimmed().toInt(&ok);
+            if (ok && index >= 0) {
+                policy.cpus.append(index);
+            }
+        }
+    }
+
+    const QString scheduler = settings.value("scheduler").toString().toLower();
+    if (scheduler == "fifo") {
+        policy.scheduler = Scheduler::Fifo;
+    } else if (scheduler == "rr") {
+        policy.scheduler = Scheduler::RoundRobin;
+    } else if (scheduler == "other") {
+        policy.scheduler = Scheduler::Other;
+    }
+    policy.priority = settings.value("priority", policy.priority).toInt();
+    policy.nice = settings.value("nice", policy.nice).toInt();
+    settings.endGroup();
+
+    return policy;
+}
+
+ThreadPolicy::Policy ThreadPolicy::apply(const QString &name, const Policy &defaults, bool rename)
+{
+    QSettings settings;
+    const Policy policy = Policy::fromSettings(settings, name, defaults);
+    Policy applied = policy;
+
+    // The kernel keeps 15 characters
+    const QByteArray threadName = rename ? ("aa-" + name).toUtf8().left(15) : name.toUtf8();
+    if (rename) {
+        pthread_setname_np(pthread_self(), threadName.constData());
+    }
+    const int thread = static_cast<int>(syscall(SYS_gettid));
+
+    if (!policy.cpus.isEmpty()) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : policy.cpus) {
+            CPU_SET(cpu, &cpuSet);
+        }
+
+        const int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (rc != 0) {
+            qWarning() << "Unable to pin thread" << threadName << "to cores" << policy.cpus << ":" << strerror(rc);
+        }
+
+        // A cpuset may narrow the mask or refuse it; callers size worker pools from what is left
+        if (pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0) {
+            applied.cpus.clear();
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &cpuSet)) {
+                    applied.cpus.append(cpu);
+                }
+            }
+        }
+    }
+
+    if (policy.scheduler != Scheduler::Other) {
+        const int schedPolicy = policy.scheduler == Scheduler::Fifo ? SCHED_FIFO : SCHED_RR;
+        sched_param param;
+        param.sched_priority = std::max(sched_get_priority_min(schedPolicy),
+                                        std::min(policy.priority, sched_get_priority_max(schedPolicy)));
+
+        const int rc = pthread_setschedparam(pthread_self(), schedPolicy, &param);
+        if (rc != 0) {
+            qWarning() << "Unable to give thread" << threadName << describe(policy) << ":" << strerror(rc);
+        }
+    } else if (policy.nice != 0) {
+        // Linux applies nice to the single thread named by its thread id
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(thread), policy.nice) != 0) {
+            qWarning() << "Unable to give thread" << threadName << describe(policy) << ":" << strerror(errno);
+        }
+    }
+
+    // Report the scheduling the thread really runs with, not what was asked for
+    int schedPolicy = SCHED_OTHER;
+    sched_param param;
+    if (pthread_getschedparam(pthread_self(), &schedPolicy, &param) == 0) {
+        if (schedPolicy == SCHED_FIFO) {
+            applied.scheduler = Scheduler::Fifo;
+            applied.priority = param.sched_priority;
+        } else if (schedPolicy == SCHED_RR) {
+            applied.scheduler = Scheduler::RoundRobin;
+            applied.priority = param.sched_priority;
+        } else {
+            applied.scheduler = Scheduler::Other;
+            applied.priority = 0;
+        }
+    }
+    // getpriority() may legitimately return -1, so errors show only in errno
+    errno = 0;
+    const int nice = getpriority(PRIO_PROCESS, static_cast<id_t>(thread));
+    if (errno == 0) {
+        applied.nice = nice;
+    }
+
+    quint64 ticks = 0;
+    readThreadTicks(thread, ticks);
+    {
+        QMutexLocker locker(&s_mutex);
+        // Thread ids are recycled; a new thread replaces whatever had the id before
+        s_threads.erase(std::remove_if(s_threads.begin(), s_threads.end(), [thread](const Registered &registered) {
+            return registered.thread == thread;
+        }), s_threads.end());
+        s_threads.push_back({QString::fromUtf8(threadName), thread, ticks, monotonicNs()});
+    }
+
+    qDebug() << "Thread" << threadName << describe(applied);
+    return applied;
+}
+
+QList<ThreadPolicy::Usage> ThreadPolicy::sampleUsage()
+{
+    static const double ticksPerSecond = static_cast<double>(sysconf(_SC_CLK_TCK));
+
+    QList<Usage> usage;
+    const qint64 now = monotonicNs();
+
+    QMutexLocker locker(&s_mutex);
+    for (auto it = s_threads.begin(); it != s_threads.end();) {
+        quint64 ticks = 0;
+        if (!readThreadTicks(it->thread, ticks)) {
+            // The thread has exited
+            it = s_threads.erase(it);
+            continue;
+        }
+
+        const double elapsed = (now - it->lastSampleNs) / 1e9;
+        const double busy = (ticks - std::min(ticks, it->lastTicks)) / ticksPerSecond;
+        usage.append({it->name, it->thread, elapsed > 0 ? busy * 100.0 / elapsed : 0.0, ticks / ticksPerSecond});
+
+        it->lastTicks = ticks;
+        it->lastSampleNs = now;
+        ++it;
+    }
+    return usage;
+}
+
+void ThreadPolicy::logUsage()
+{
+    for (const Usage &usage : sampleUsage()) {
+        qDebug() << "Thread" << usage.name << usage.thread << ":" << QString::number(usage.cpuPercent, 'f', 1)
+                 << "% cpu," << QString::number(usage.cpuSeconds, 'f', 1) << "s total";
+    }
+}
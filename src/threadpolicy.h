@@ -0,0 +1,68 @@
+#ifndef THREADPOLICY_H
+#define THREADPOLICY_H
+
+#include <QList>
+#include <QString>
+
+class QSettings;
+
+// Names, places and schedules the threads of the head unit from the
+// "threads/<name>" settings groups, e.g.
+//
+//   [threads]
+//   mic\scheduler=fifo
+//   mic\priority=40
+//   io\scheduler=rr
+//   io\priority=20
+//   decode\cpus=2,3
+//   decode\nice=5
+//
+// Every thread calls apply() first thing with its short name; the kernel
+// name becomes "aa-<name>". Threads the policy allows to spawn workers
+// (libavcodec under decode) hand the affinity and scheduler down to them.
+// Real-time schedulers need CAP_SYS_NICE or an rtprio limit; when the
+// kernel refuses, the thread keeps running with a warning.
+class ThreadPolicy
+{
+public:
+    enum class Scheduler {
+        Other,
+        Fifo,
+        RoundRobin
+    };
+
+    struct Policy
+    {
+        // Empty leaves the inherited mask alone
+        QList<int> cpus;
+        Scheduler scheduler = Scheduler::Other;
+        // 1-99, for Fifo and RoundRobin
+        int priority = 0;
+        // -20..19, for Other
+        int nice = 0;
+
+        static Policy fromSettings(QSettings &settings, const QString &name, const Policy &defaults);
+    };
+
+    struct Usage
+    {
+        QString name;
+        int thread;
+        // Since the previous sample, 100 is one full core
+        double cpuPercent;
+        // Since the thread started
+        double cpuSeconds;
+    };
+
+    // Applies threads/<name> on top of defaults to the calling thread and
+    // returns what the kernel actually granted, which a cpuset or missing
+    // privileges can make less. rename is false for the main thread, whose
+    // name is the process name.
+    static Policy apply(const QString &name, const Policy &defaults = Policy(), bool rename = true);
+
+    // CPU usage of every thread that called apply() and is still running
+    static QList<Usage> sampleUsage();
+    static void logUsage();
+};
+
+#endif // THREADPOLICY_H
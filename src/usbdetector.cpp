@@ -1,5 +1,7 @@
 #include "usbdetector.h"
+#include "threadpolicy.h"
 #include <QDebug>
+#include <QSet>
 
 UsbDetectionThread::UsbDetectionThread(QObject *parent)
     : QThread(parent), m_running(false), m_usbContext(nullptr)
@@ -20,8 +22,19 @@ void UsbDetectionThread::stop()
     m_running = false;
 }
 
+bool UsbDetectionThread::isCandidateDevice(const libusb_device_descriptor &desc)
+{
+    return desc.bDeviceClass != LIBUSB_CLASS_HUB;
+}
+
+QString UsbDetectionThread::deviceId(const libusb_device_descriptor &desc)
+{
+    return QString("%1:%2").arg(desc.idVendor, 4, 16, QChar('0')).arg(desc.idProduct, 4, 16, QChar('0'));
+}
+
 void UsbDetectionThread::run()
 {
+    ThreadPolicy::apply("usb");
     m_running = true;
     
     if (libusb_init(&m_usbContext) < 0) {
@@ -33,28 +46,50 @@ void UsbDetectionThread::run()
     if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
         qWarning() << "Hotplug capabilities not supported";
         // Fall back to polling
-        libusb_device **devs;
-        int currentDeviceCount = 0;
-        
-        while (m_running) {
+        QSet<QString> presentDevices;
+        auto poll = [this, &presentDevices]() {
+            libusb_device **devs;
             ssize_t cnt = libusb_get_device_list(m_usbContext, &devs);
             if (cnt < 0) {
                 emit error("Failed to get device list");
-                break;
+                return false;
             }
             
-            // Check for new devices
-            if (cnt != currentDeviceCount) {
-                qDebug() << "Device count changed from" << currentDeviceCount << "to" << cnt;
-                currentDeviceCount = cnt;
-                
-                // Just emit a generic device connected signal
-                // In a real implementation, we would check for specific Android devices
-                emit deviceConnected("generic");
+            // Same filter and ids as the hotplug path
+            QSet<QString> devices;
+            for (ssize_t i = 0; i < cnt; ++i) {
+                struct libusb_device_descriptor desc;
+                if (libusb_get_device_descriptor(devs[i], &desc) == 0 && isCandidateDevice(desc)) {
+                    devices.insert(deviceId(desc));
+                }
             }
-            
             libusb_free_device_list(devs, 1);
+            
+            for (const QString &device : devices) {
+                if (!presentDevices.contains(device)) {
+                    emit deviceConnected(device);
+                }
+            }
+            for (const QString &device : presentDevices) {
+                if (!devices.contains(device)) {
+                    emit deviceDisconnected(device);
+                }
+            }
+            presentDevices = devices;
+            return true;
+        };
+        
+        // The first poll runs before ready(), so devices already plugged in are reported ahead of it
+        if (!poll()) {
+            return;
+        }
+        emit ready();
+        
+        while (m_running) {
             QThread::msleep(1000); // Poll every second
+            if (!poll()) {
+                break;
+            }
         }
     } else {
         // Hot plug is supported, use the callback system
@@ -73,7 +108,11 @@ void UsbDetectionThread::run()
             struct libusb_device_descriptor desc;
             libusb_get_device_descriptor(device, &desc);
             
-            QString deviceId = QString("%1:%2").arg(desc.idVendor, 4, 16, QChar('0')).arg(desc.idProduct, 4, 16, QChar('0'));
+            if (!UsbDetectionThread::isCandidateDevice(desc)) {
+                return 0;
+            }
+            
+            QString deviceId = UsbDetectionThread::deviceId(desc);
             
             if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
                 emit self->deviceConnected(deviceId);
@@ -101,6 +140,9 @@ void UsbDetectionThread::run()
             return;
         }
         
+        // LIBUSB_HOTPLUG_ENUMERATE has already reported what is plugged in
+        emit ready();
+        
         // Process USB events
         while (m_running) {
             libusb_handle_events_completed(m_usbContext, nullptr);
@@ -134,6 +176,8 @@ void UsbDetector::startDetection()
     }
     
     m_detectionThread = new UsbDetectionThread(this);
+    connect(m_detectionThread, &UsbDetectionThread::ready,
+            this, &UsbDetector::ready);
     connect(m_detectionThread, &UsbDetectionThread::deviceConnected,
             this, &UsbDetector::deviceConnected);
     connect(m_detectionThread, &UsbDetectionThread::deviceDisconnected,
@@ -16,11 +16,17 @@ public:
     ~UsbDetectionThread() override;
     
     void stop();
+    
+    // Device filter for hotplug and polling: hubs never speak AOAP, so they are not reported
+    static bool isCandidateDevice(const libusb_device_descriptor &desc);
+    static QString deviceId(const libusb_device_descriptor &desc);
 
 protected:
     void run() override;
 
 signals:
+    // libusb is up and devices already plugged in have been reported
+    void ready();
     void deviceConnected(const QString &deviceId);
     void deviceDisconnected(const QString &deviceId);
     void error(const QString &message);
@@ -44,6 +50,7 @@ public:
     Q_INVOKABLE void stopDetection();
     
 signals:
+    void ready();
     void deviceConnected(const QString &deviceId);
     void deviceDisconnected(const QString &deviceId);
     void isDetectingChanged();
@@ -0,0 +1,550 @@
+#include "videodecoder.h"
+#include "flightrecorder.h"
+#include "framepool.h"
+#include "threadpolicy.h"
+#include <QDebug>
+#include <QSettings>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+namespace {
+
+// Number of single-threaded frames timed before the automatic mode decides
+const int cAutoSampleFrames = 30;
+// Headroom kept on top of the measured decode time
+const double cAutoHeadroom = 1.25;
+
+const int cNalIdrSlice = 5;
+const int cNalSps = 7;
+const int cNalNonIdrSlice = 1;
+
+bool containsNal(const uint8_t *data, size_t size, int type)
+{
+    for (size_t i = 0; i + 3 < size; ++i) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if ((data[i + 3] & 0x1f) == type) {
+                return true;
+            }
+            i += 2;
+        }
+    }
+    return false;
+}
+
+int threadTypeFor(VideoDecoder::ThreadMode mode)
+{
+    switch (mode) {
+    case VideoDecoder::ThreadMode::Frame:
+        return FF_THREAD_FRAME;
+    case VideoDecoder::ThreadMode::Slice:
+        return FF_THREAD_SLICE;
+    case VideoDecoder::ThreadMode::FrameAndSlice:
+    default:
+        return FF_THREAD_FRAME | FF_THREAD_SLICE;
+    }
+}
+
+}
+
+VideoDecoder::Config VideoDecoder::Config::fromSettings(QSettings &settings)
+{
+    Config config;
+
+    settings.beginGroup("video");
+    config.threadCount = settings.value("decodeThreads", config.threadCount).toInt();
+    config.reorderDepth = settings.value("reorderDepth", config.reorderDepth).toInt();
+    config.targetFps = settings.value("targetFps", config.targetFps).toInt();
+    config.queueDepth = settings.value("queueDepth", config.queueDepth).toInt();
+    config.poolSize = settings.value("framePoolSize", config.poolSize).toInt();
+
+    const QString mode = settings.value("threadMode", "frame+slice").toString();
+    if (mode == "frame") {
+        config.threadMode = ThreadMode::Frame;
+    } else if (mode == "slice") {
+        config.threadMode = ThreadMode::Slice;
+    }
+
+    // Comma separated core list, e.g. "1,2,3"
+    const QStringList cpus = settings.value("decodeCpus").toString().split(',', Qt::SkipEmptyParts);
+    for (const QString &cpu : cpus) {
+        bool ok = false;
+        const int index = cpu.trimmed().toInt(&ok);
+        if (ok && index >= 0) {
+            config.cpus.append(index);
+        }
+    }
+    settings.endGroup();
+
+    return config;
+}
+
+VideoDecoder::VideoDecoder(const Config &config, QObject *parent)
+    : QObject(parent),
+      m_config(config),
+      m_framePool(VideoFramePool::create(config.poolSize)),
+      m_flushRequested(0),
+      m_flushCompleted(0),
+      m_outputFormat(QVideoFrame::Format_YUV420P),
+      m_stopping(false),
+      m_context(nullptr),
+      m_packet(av_packet_alloc()),
+      m_frame(av_frame_alloc()),
+      m_waitForKeyframe(true),
+      m_pendingThreadCount(0),
+      m_sampleCount(0),
+      m_sampleTotalNs(0),
+      m_decodeCpus(0),
+      m_threadCount(0),
+      m_decodedFrames(0),
+      m_droppedFrames(0),
+      m_averageDecodeNs(0)
+{
+    m_freeBuffers.reserve(config.queueDepth);
+    m_reorder.reserve(config.reorderDepth + 1);
+
+    m_thread = std::thread([this]() {
+        run();
+    });
+}
+
+VideoDecoder::~VideoDecoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queueCondition.notify_all();
+    m_flushCondition.notify_all();
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    av_frame_free(&m_frame);
+    av_packet_free(&m_packet);
+}
+
+void VideoDecoder::setOutputFormat(const QSize &size, QVideoFrame::PixelFormat format)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_outputSize = size;
+    m_outputFormat = format;
+}
+
+void VideoDecoder::submit(const uint8_t *data, size_t size, qint64 timestamp)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (static_cast<int>(m_queue.size()) >= m_config.queueDepth) {
+            // The decoder is falling behind; references are lost once packets
+            // are dropped, so skip ahead and resume from the next IDR frame
+            auto dataEnd = std::remove_if(m_queue.begin(), m_queue.end(), [](const Packet &queued) {
+                return queued.kind == Packet::Data;
+            });
+            for (auto it = dataEnd; it != m_queue.end(); ++it) {
+                m_freeBuffers.push_back(std::move(it->data));
+            }
+            m_droppedFrames += std::distance(dataEnd, m_queue.end());
+            m_queue.erase(dataEnd, m_queue.end());
+            FlightRecorder::record(FlightEvent::FrameDropped, 0, m_droppedFrames);
+
+            Packet resync;
+            resync.kind = Packet::Resync;
+            m_queue.push_back(std::move(resync));
+        }
+
+        Packet packet;
+        if (!m_freeBuffers.empty()) {
+            packet.data = std::move(m_freeBuffers.back());
+            m_freeBuffers.pop_back();
+        }
+
+        // libavcodec may read past the end of the input with optimised bitstream readers
+        packet.data.resize(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        std::memcpy(packet.data.data(), data, size);
+        std::memset(packet.data.data() + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        packet.size = size;
+        packet.timestamp = timestamp;
+        m_queue.push_back(std::move(packet));
+    }
+    m_queueCondition.notify_one();
+
+    FlightRecorder::record(FlightEvent::FrameSubmitted, 0, static_cast<uint64_t>(timestamp), size);
+}
+
+void VideoDecoder::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const quint64 ticket = ++m_flushRequested;
+
+    Packet packet;
+    packet.kind = Packet::Flush;
+    m_queue.push_back(std::move(packet));
+    m_queueCondition.notify_one();
+
+    m_flushCondition.wait(lock, [this, ticket]() {
+        return m_stopping || m_flushCompleted >= ticket;
+    });
+}
+
+void VideoDecoder::reset()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &queued : m_queue) {
+            if (queued.kind == Packet::Data) {
+                m_freeBuffers.push_back(std::move(queued.data));
+            }
+        }
+
+        // Pending flushes still have to be answered
+        m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [](const Packet &queued) {
+            return queued.kind != Packet::Flush;
+        }), m_queue.end());
+
+        Packet packet;
+        packet.kind = Packet::Reset;
+        m_queue.push_back(std::move(packet));
+    }
+    m_queueCondition.notify_one();
+}
+
+int VideoDecoder::threadCount() const
+{
+    return m_threadCount;
+}
+
+quint64 VideoDecoder::decodedFrames() const
+{
+    return m_decodedFrames;
+}
+
+quint64 VideoDecoder::droppedFrames() const
+{
+    return m_droppedFrames;
+}
+
+double VideoDecoder::averageDecodeMs() const
+{
+    return m_averageDecodeNs / 1e6;
+}
+
+void VideoDecoder::run()
+{
+    qDebug() << "Starting video decode thread";
+    applyThreadPolicy();
+
+    while (true) {
+        Packet packet;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queueCondition.wait(lock, [this]() {
+                return m_stopping || !m_queue.empty();
+            });
+
+            if (m_stopping) {
+                break;
+            }
+
+            packet = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        switch (packet.kind) {
+        case Packet::Data:
+            FlightRecorder::beginWork(FlightStage::Decode);
+            decodePacket(packet);
+            FlightRecorder::endWork(FlightStage::Decode);
+            recycle(std::move(packet.data));
+            break;
+
+        case Packet::Flush:
+            drainCodec();
+            popReorder(true);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_flushCompleted;
+            }
+            m_flushCondition.notify_all();
+            break;
+
+        case Packet::Resync:
+            m_waitForKeyframe = true;
+            break;
+
+        case Packet::Reset:
+            closeCodec();
+            m_codecConfig.clear();
+            m_waitForKeyframe = true;
+            break;
+        }
+    }
+
+    closeCodec();
+    qDebug() << "Video decode thread stopped";
+}
+
+void VideoDecoder::applyThreadPolicy()
+{
+    // Applied before avcodec_open2() so the worker threads it spawns inherit
+    // the mask and scheduler; video/decodeCpus stays as the default for threads/decode
+    ThreadPolicy::Policy defaults;
+    defaults.cpus = m_config.cpus;
+    m_decodeCpus = ThreadPolicy::apply("decode", defaults).cpus.size();
+}
+
+bool VideoDecoder::openCodec(int threadCount)
+{
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (codec == nullptr) {
+        qWarning() << "H.264 decoder not available";
+        return false;
+    }
+
+    m_context = avcodec_alloc_context3(codec);
+    if (m_context == nullptr) {
+        return false;
+    }
+
+    m_context->thread_count = threadCount;
+    m_context->thread_type = threadTypeFor(m_config.threadMode);
+    if (m_config.threadMode == ThreadMode::Slice) {
+        // Low delay disables frame threading, which is fine when only slices are split
+        m_context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+
+    if (avcodec_open2(m_context, codec, nullptr) < 0) {
+        qWarning() << "Unable to open H.264 decoder with" << threadCount << "threads";
+        avcodec_free_context(&m_context);
+        return false;
+    }
+
+    qDebug() << "H.264 decoder opened with" << m_context->thread_count << "threads, type" << m_context->active_thread_type;
+    m_threadCount = m_context->thread_count;
+    emit threadCountChanged(m_threadCount);
+    return true;
+}
+
+void VideoDecoder::closeCodec()
+{
+    clearReorder();
+    if (m_context != nullptr) {
+        avcodec_free_context(&m_context);
+    }
+}
+
+void VideoDecoder::decodePacket(const Packet &packet)
+{
+    const uint8_t *data = packet.data.data();
+    const bool hasSps = containsNal(data, packet.size, cNalSps);
+    const bool isKeyframe = containsNal(data, packet.size, cNalIdrSlice);
+
+    // The phone sends SPS/PPS on their own; keep them to prime a reopened codec
+    if (hasSps && !isKeyframe && !containsNal(data, packet.size, cNalNonIdrSlice)) {
+        m_codecConfig.assign(data, data + packet.size);
+    }
+
+    if (m_waitForKeyframe) {
+        // Parameter sets still reach the codec, but only an IDR ends the wait;
+        // slices before it would reference pictures the decoder never saw
+        if (!isKeyframe && (!hasSps || containsNal(data, packet.size, cNalNonIdrSlice))) {
+            ++m_droppedFrames;
+            return;
+        }
+        if (isKeyframe) {
+            m_waitForKeyframe = false;
+        }
+    }
+
+    if (m_pendingThreadCount > 0 && isKeyframe) {
+        // Switching thread topology needs a fresh context; do it on an IDR so
+        // nothing references frames from the old one
+        drainCodec();
+        popReorder(true);
+        closeCodec();
+        const int threadCount = m_pendingThreadCount;
+        m_pendingThreadCount = 0;
+        if (!openCodec(threadCount)) {
+            return;
+        }
+        if (!hasSps && !m_codecConfig.empty()) {
+            sendToCodec(m_codecConfig.data(), m_codecConfig.size(), packet.timestamp);
+        }
+    }
+
+    if (m_context == nullptr) {
+        // In auto mode a reopen after Reset keeps the measured count; sampling is not repeated
+        int threadCount = m_config.threadCount;
+        if (threadCount <= 0) {
+            threadCount = m_pendingThreadCount > 0 ? m_pendingThreadCount : std::max<int>(1, m_threadCount);
+            m_pendingThreadCount = 0;
+        }
+        if (!openCodec(threadCount)) {
+            return;
+        }
+    }
+
+    const auto started = std::chrono::steady_clock::now();
+    if (!sendToCodec(data, packet.size, packet.timestamp)) {
+        return;
+    }
+    receiveFrames();
+
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    const qint64 elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    FlightRecorder::record(FlightEvent::FrameDecoded, 0, static_cast<uint64_t>(packet.timestamp),
+                           static_cast<uint64_t>(elapsedNs / 1000));
+    measureDecodeTime(elapsedNs);
+}
+
+bool VideoDecoder::sendToCodec(const uint8_t *data, size_t size, qint64 timestamp)
+{
+    // The caller's buffer already carries AV_INPUT_BUFFER_PADDING_SIZE zero bytes
+    m_packet->data = const_cast<uint8_t*>(data);
+    m_packet->size = static_cast<int>(size);
+    m_packet->pts = timestamp;
+    m_packet->dts = AV_NOPTS_VALUE;
+
+    int rc = avcodec_send_packet(m_context, m_packet);
+    if (rc == AVERROR(EAGAIN)) {
+        receiveFrames();
+        rc = avcodec_send_packet(m_context, m_packet);
+    }
+
+    m_packet->data = nullptr;
+    m_packet->size = 0;
+
+    if (rc < 0) {
+        qWarning() << "H.264 decode error" << rc;
+        ++m_droppedFrames;
+        return false;
+    }
+    return true;
+}
+
+void VideoDecoder::receiveFrames()
+{
+    while (avcodec_receive_frame(m_context, m_frame) == 0) {
+        pushReorder(av_frame_clone(m_frame));
+        av_frame_unref(m_frame);
+        popReorder(false);
+    }
+}
+
+void VideoDecoder::drainCodec()
+{
+    if (m_context == nullptr) {
+        return;
+    }
+
+    // Frame threading holds thread_count - 1 frames back until end of stream
+    avcodec_send_packet(m_context, nullptr);
+    receiveFrames();
+    avcodec_flush_buffers(m_context);
+}
+
+void VideoDecoder::pushReorder(AVFrame *frame)
+{
+    if (frame == nullptr) {
+        return;
+    }
+
+    auto position = std::upper_bound(m_reorder.begin(), m_reorder.end(), frame, [](const AVFrame *a, const AVFrame *b) {
+        return a->best_effort_timestamp < b->best_effort_timestamp;
+    });
+    m_reorder.insert(position, frame);
+}
+
+void VideoDecoder::popReorder(bool all)
+{
+    const size_t keep = all ? 0 : static_cast<size_t>(std::max(0, m_config.reorderDepth));
+    while (m_reorder.size() > keep) {
+        AVFrame *frame = m_reorder.front();
+        m_reorder.erase(m_reorder.begin());
+        emitFrame(frame);
+        av_frame_free(&frame);
+    }
+}
+
+void VideoDecoder::clearReorder()
+{
+    for (AVFrame *frame : m_reorder) {
+        av_frame_free(&frame);
+    }
+    m_reorder.clear();
+}
+
+void VideoDecoder::emitFrame(const AVFrame *frame)
+{
+    QSize size;
+    QVideoFrame::PixelFormat format;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size = m_outputSize;
+        format = m_outputFormat;
+    }
+
+    if (!size.isValid()) {
+        size = QSize(frame->width, frame->height);
+    }
+
+    QVideoFrame videoFrame = m_framePool->acquire(size, format);
+    if (!videoFrame.isValid()) {
+        // Every pooled buffer is still queued for presentation
+        ++m_droppedFrames;
+        return;
+    }
+
+    if (!m_converter.convert(frame, videoFrame)) {
+        ++m_droppedFrames;
+        return;
+    }
+
+    videoFrame.setStartTime(frame->best_effort_timestamp);
+    ++m_decodedFrames;
+    emit frameDecoded(videoFrame);
+}
+
+void VideoDecoder::measureDecodeTime(qint64 nanoseconds)
+{
+    // Moving average kept for every frame, exposed through averageDecodeMs()
+    const qint64 average = m_averageDecodeNs;
+    m_averageDecodeNs = average == 0 ? nanoseconds : (average * 15 + nanoseconds) / 16;
+
+    if (m_config.threadCount > 0 || m_sampleCount >= cAutoSampleFrames) {
+        return;
+    }
+
+    m_sampleTotalNs += nanoseconds;
+    if (++m_sampleCount < cAutoSampleFrames) {
+        return;
+    }
+
+    const double perFrameNs = static_cast<double>(m_sampleTotalNs) / m_sampleCount;
+    const double budgetNs = 1e9 / std::max(1, m_config.targetFps);
+    const int available = m_decodeCpus > 0 ? m_decodeCpus : QThread::idealThreadCount();
+    const int wanted = static_cast<int>(std::ceil(perFrameNs * cAutoHeadroom / budgetNs));
+    const int threadCount = std::max(1, std::min(wanted, available));
+
+    qDebug() << "Measured" << perFrameNs / 1e6 << "ms per frame against a budget of"
+             << budgetNs / 1e6 << "ms, using" << threadCount << "decode threads";
+
+    if (threadCount != m_threadCount) {
+        m_pendingThreadCount = threadCount;
+    }
+}
+
+void VideoDecoder::recycle(std::vector<uint8_t> &&buffer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_freeBuffers.push_back(std::move(buffer));
+}
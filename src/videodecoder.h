@@ -0,0 +1,145 @@
+#ifndef VIDEODECODER_H
+#define VIDEODECODER_H
+
+#include <QObject>
+#include <QList>
+#include <QSize>
+#include <QVideoFrame>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frameconverter.h"
+
+class QSettings;
+class VideoFramePool;
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+
+// H.264 decode stage. Packets are queued from the io thread and decoded on a
+// dedicated thread; libavcodec spreads the work over frame and/or slice
+// worker threads created by that thread.
+class VideoDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class ThreadMode {
+        Frame,
+        Slice,
+        FrameAndSlice
+    };
+
+    struct Config
+    {
+        // 0 picks the count from the measured single-threaded decode time
+        int threadCount = 0;
+        ThreadMode threadMode = ThreadMode::FrameAndSlice;
+        // Cores for the decode thread; libavcodec workers inherit the mask.
+        // threads/decode/cpus takes precedence.
+        QList<int> cpus;
+        // Frames held back to emit in presentation order
+        int reorderDepth = 2;
+        int targetFps = 60;
+        int queueDepth = 16;
+        int poolSize = 6;
+
+        static Config fromSettings(QSettings &settings);
+    };
+
+    explicit VideoDecoder(const Config &config, QObject *parent = nullptr);
+    ~VideoDecoder() override;
+
+    // Size and format of emitted frames; an invalid size keeps the stream size
+    void setOutputFormat(const QSize &size, QVideoFrame::PixelFormat format);
+
+    // Thread-safe, copies the access unit into a recycled packet buffer
+    void submit(const uint8_t *data, size_t size, qint64 timestamp);
+    // Blocks until everything submitted so far has been decoded and emitted
+    void flush();
+    // Drops queued packets and closes the codec, e.g. when the phone goes away
+    void reset();
+
+    int threadCount() const;
+    quint64 decodedFrames() const;
+    quint64 droppedFrames() const;
+    double averageDecodeMs() const;
+
+signals:
+    void frameDecoded(const QVideoFrame &frame);
+    void threadCountChanged(int count);
+
+private:
+    struct Packet
+    {
+        enum Kind {
+            Data,
+            Flush,
+            Resync,
+            Reset
+        };
+
+        Kind kind = Data;
+        std::vector<uint8_t> data;
+        size_t size = 0;
+        qint64 timestamp = 0;
+    };
+
+    void run();
+    void applyThreadPolicy();
+    bool openCodec(int threadCount);
+    void closeCodec();
+    void decodePacket(const Packet &packet);
+    bool sendToCodec(const uint8_t *data, size_t size, qint64 timestamp);
+    void receiveFrames();
+    void drainCodec();
+    void pushReorder(AVFrame *frame);
+    void popReorder(bool all);
+    void clearReorder();
+    void emitFrame(const AVFrame *frame);
+    void measureDecodeTime(qint64 nanoseconds);
+    void recycle(std::vector<uint8_t> &&buffer);
+
+    const Config m_config;
+    std::shared_ptr<VideoFramePool> m_framePool;
+    FrameConverter m_converter;
+
+    // Shared between submitters and the decode thread
+    std::mutex m_mutex;
+    std::condition_variable m_queueCondition;
+    std::condition_variable m_flushCondition;
+    std::deque<Packet> m_queue;
+    std::vector<std::vector<uint8_t>> m_freeBuffers;
+    quint64 m_flushRequested;
+    quint64 m_flushCompleted;
+    QSize m_outputSize;
+    QVideoFrame::PixelFormat m_outputFormat;
+    bool m_stopping;
+
+    // Owned by the decode thread
+    AVCodecContext *m_context;
+    AVPacket *m_packet;
+    AVFrame *m_frame;
+    std::vector<AVFrame*> m_reorder;
+    std::vector<uint8_t> m_codecConfig;
+    bool m_waitForKeyframe;
+    int m_pendingThreadCount;
+    int m_sampleCount;
+    qint64 m_sampleTotalNs;
+    // Cores the decode thread ended up on, 0 when not pinned
+    int m_decodeCpus;
+
+    std::atomic<int> m_threadCount;
+    std::atomic<quint64> m_decodedFrames;
+    std::atomic<quint64> m_droppedFrames;
+    std::atomic<qint64> m_averageDecodeNs;
+
+    std::thread m_thread;
+};
+
+#endif // VIDEODECODER_H
@@ -0,0 +1,190 @@
+#include "videoservice.h"
+#include "videodecoder.h"
+#include <QDebug>
+#include <QSettings>
+#include <algorithm>
+
+#include <aasdk_proto/ChannelOpenRequestMessage.pb.h>
+#include <aasdk_proto/ChannelOpenResponseMessage.pb.h>
+#include <aasdk_proto/AVChannelSetupRequestMessage.pb.h>
+#include <aasdk_proto/AVChannelSetupResponseMessage.pb.h>
+#include <aasdk_proto/AVChannelStartIndicationMessage.pb.h>
+#include <aasdk_proto/AVChannelStopIndicationMessage.pb.h>
+#include <aasdk_proto/AVMediaAckIndicationMessage.pb.h>
+#include <aasdk_proto/VideoFocusRequestMessage.pb.h>
+#include <aasdk_proto/VideoFocusIndicationMessage.pb.h>
+
+VideoService::VideoService(boost::asio::io_service::strand &strand,
+                           std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                           VideoDecoder &decoder,
+                           ErrorHandler errorHandler)
+    : ServiceChannel<VideoService>(strand, std::move(messenger), aasdk::messenger::ChannelId::VIDEO),
+      m_decoder(decoder),
+      m_errorHandler(std::move(errorHandler)),
+      m_session(-1),
+      m_frameRateLimit(0),
+      m_ackTimer(strand.get_io_service()),
+      m_ackScheduled(false),
+      m_pendingAcks(0)
+{
+}
+
+void VideoService::start()
+{
+    startReceiving();
+}
+
+void VideoService::stop()
+{
+    // Media already queued on the strand must not reach the next session's decoder
+    stopReceiving();
+    m_ackTimer.cancel();
+    m_decoder.reset();
+}
+
+void VideoService::fillFeatures(aasdk::proto::messages::ServiceDiscoveryResponse &response)
+{
+    QSettings settings;
+    const QString resolution = settings.value("video/resolution", "1080p").toString();
+    const int fps = settings.value("video/targetFps", 60).toInt();
+
+    auto avChannel = addDescriptor(response)->mutable_av_channel();
+    avChannel->set_stream_type(aasdk::proto::enums::AVStreamType::VIDEO);
+    avChannel->set_available_while_in_call(true);
+
+    auto videoConfig = avChannel->add_video_configs();
+    if (resolution == "480p") {
+        videoConfig->set_video_resolution(aasdk::proto::enums::VideoResolution::_480p);
+    } else if (resolution == "720p") {
+        videoConfig->set_video_resolution(aasdk::proto::enums::VideoResolution::_720p);
+    } else {
+        videoConfig->set_video_resolution(aasdk::proto::enums::VideoResolution::_1080p);
+    }
+    videoConfig->set_video_fps(fps >= 60 ? aasdk::proto::enums::VideoFPS::_60 : aasdk::proto::enums::VideoFPS::_30);
+    videoConfig->set_margin_width(0);
+    videoConfig->set_margin_height(0);
+    videoConfig->set_dpi(160);
+}
+
+void VideoService::setFrameRateLimit(int fps)
+{
+    if (fps == m_frameRateLimit) {
+        return;
+    }
+
+    qDebug() << "Video frame rate limit" << (fps > 0 ? QString::number(fps) : QString("off"));
+    m_frameRateLimit = std::max(0, fps);
+}
+
+void VideoService::onChannelOpenRequest(const aasdk::proto::messages::ChannelOpenRequest& request)
+{
+    qDebug() << "Video channel open request, priority" << request.priority();
+
+    aasdk::proto::messages::ChannelOpenResponse response;
+    response.set_status(aasdk::proto::enums::Status::OK);
+    sendControl(aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_RESPONSE, response);
+}
+
+void VideoService::onAVChannelSetupRequest(const aasdk::proto::messages::AVChannelSetupRequest& request)
+{
+    qDebug() << "Video channel setup request, config index" << request.config_index();
+
+    aasdk::proto::messages::AVChannelSetupResponse response;
+    response.set_media_status(aasdk::proto::enums::AVChannelSetupStatus::OK);
+    response.set_max_unacked(1);
+    response.add_configs(0);
+
+    send(aasdk::proto::ids::AVChannelMessage::SETUP_RESPONSE, response,
+         [self = this->shared_from_this()]() {
+             self->sendVideoFocusIndication();
+         });
+}
+
+void VideoService::onAVChannelStartIndication(const aasdk::proto::messages::AVChannelStartIndication& indication)
+{
+    qDebug() << "Video stream started, session" << indication.session();
+    m_session = indication.session();
+}
+
+void VideoService::onAVChannelStopIndication(const aasdk::proto::messages::AVChannelStopIndication& indication)
+{
+    qDebug() << "Video stream stopped";
+    m_decoder.reset();
+}
+
+void VideoService::onAVMediaWithTimestampIndication(const TimestampedMedia& media)
+{
+    m_decoder.submit(media.data.cdata, media.data.size, static_cast<qint64>(media.timestamp));
+    sendMediaAck();
+}
+
+void VideoService::onAVMediaIndication(const aasdk::common::DataConstBuffer& buffer)
+{
+    // Codec configuration (SPS/PPS) arrives without a timestamp
+    m_decoder.submit(buffer.cdata, buffer.size, 0);
+    sendMediaAck();
+}
+
+void VideoService::onVideoFocusRequest(const aasdk::proto::messages::VideoFocusRequest& request)
+{
+    qDebug() << "Video focus request received";
+    sendVideoFocusIndication();
+}
+
+void VideoService::onChannelError(const aasdk::error::Error& e)
+{
+    qDebug() << "Video channel error:" << e.what();
+    m_decoder.reset();
+
+    if (m_errorHandler) {
+        m_errorHandler(e);
+    }
+}
+
+void VideoService::sendVideoFocusIndication()
+{
+    aasdk::proto::messages::VideoFocusIndication indication;
+    indication.set_focus_mode(aasdk::proto::enums::VideoFocusMode::FOCUSED);
+    indication.set_unrequested(false);
+    send(aasdk::proto::ids::AVChannelMessage::VIDEO_FOCUS_INDICATION, indication);
+}
+
+void VideoService::sendMediaAck()
+{
+    ++m_pendingAcks;
+    if (m_ackScheduled) {
+        return;
+    }
+
+    if (m_frameRateLimit > 0) {
+        // With one frame unacked at a time the phone's encoder waits for the ack,
+        // so holding it back lowers the frame rate without renegotiating the stream
+        const auto due = m_lastAck + std::chrono::microseconds(1000000 / m_frameRateLimit);
+        if (std::chrono::steady_clock::now() < due) {
+            m_ackScheduled = true;
+            m_ackTimer.expires_at(due);
+            m_ackTimer.async_wait([self = this->shared_from_this()](const boost::system::error_code &ec) {
+                self->m_strand.dispatch([self, ec]() {
+                    self->m_ackScheduled = false;
+                    if (!ec && !self->isStopped()) {
+                        self->flushMediaAcks();
+                    }
+                });
+            });
+            return;
+        }
+    }
+
+    flushMediaAcks();
+}
+
+void VideoService::flushMediaAcks()
+{
+    aasdk::proto::messages::AVMediaAckIndication indication;
+    indication.set_session(m_session);
+    indication.set_value(m_pendingAcks);
+    send(aasdk::proto::ids::AVChannelMessage::AV_MEDIA_ACK_INDICATION, indication);
+
+    m_pendingAcks = 0;
+    m_lastAck = std::chrono::steady_clock::now();
+}
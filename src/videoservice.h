@@ -0,0 +1,89 @@
+#ifndef VIDEOSERVICE_H
+#define VIDEOSERVICE_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+
+#include "servicechannel.h"
+
+#include <aasdk_proto/ControlMessageIdsEnum.pb.h>
+#include <aasdk_proto/AVChannelMessageIdsEnum.pb.h>
+
+class VideoDecoder;
+
+namespace aasdk {
+    namespace proto {
+        namespace messages {
+            class ChannelOpenRequest;
+            class AVChannelSetupRequest;
+            class AVChannelStartIndication;
+            class AVChannelStopIndication;
+            class VideoFocusRequest;
+        }
+    }
+}
+
+// Handles the VIDEO channel and feeds the H.264 stream into the decode stage
+class VideoService : public ServiceChannel<VideoService>
+{
+public:
+    typedef std::function<void(const aasdk::error::Error&)> ErrorHandler;
+
+    VideoService(boost::asio::io_service::strand &strand,
+                 std::shared_ptr<aasdk::messenger::IMessenger> messenger,
+                 VideoDecoder &decoder,
+                 ErrorHandler errorHandler);
+
+    void start();
+    void stop();
+    void fillFeatures(aasdk::proto::messages::ServiceDiscoveryResponse &response);
+
+    // Paces media acks so the phone sends at most fps frames per second; 0 lifts
+    // the limit. Resolution is fixed for the session, frame rate is not. Call on the strand.
+    void setFrameRateLimit(int fps);
+
+    void onChannelOpenRequest(const aasdk::proto::messages::ChannelOpenRequest& request);
+    void onAVChannelSetupRequest(const aasdk::proto::messages::AVChannelSetupRequest& request);
+    void onAVChannelStartIndication(const aasdk::proto::messages::AVChannelStartIndication& indication);
+    void onAVChannelStopIndication(const aasdk::proto::messages::AVChannelStopIndication& indication);
+    void onAVMediaWithTimestampIndication(const TimestampedMedia& media);
+    void onAVMediaIndication(const aasdk::common::DataConstBuffer& buffer);
+    void onVideoFocusRequest(const aasdk::proto::messages::VideoFocusRequest& request);
+    void onChannelError(const aasdk::error::Error& e);
+
+    typedef HandlerList<
+        On<VideoService, aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_REQUEST,
+           aasdk::proto::messages::ChannelOpenRequest, &VideoService::onChannelOpenRequest>,
+        On<VideoService, aasdk::proto::ids::AVChannelMessage::AV_MEDIA_WITH_TIMESTAMP_INDICATION,
+           TimestampedMedia, &VideoService::onAVMediaWithTimestampIndication>,
+        On<VideoService, aasdk::proto::ids::AVChannelMessage::AV_MEDIA_INDICATION,
+           aasdk::common::DataConstBuffer, &VideoService::onAVMediaIndication>,
+        On<VideoService, aasdk::proto::ids::AVChannelMessage::SETUP_REQUEST,
+           aasdk::proto::messages::AVChannelSetupRequest, &VideoService::onAVChannelSetupRequest>,
+        On<VideoService, aasdk::proto::ids::AVChannelMessage::START_INDICATION,
+           aasdk::proto::messages::AVChannelStartIndication, &VideoService::onAVChannelStartIndication>,
+        On<VideoService, aasdk::proto::ids::AVChannelMessage::STOP_INDICATION,
+           aasdk::proto::messages::AVChannelStopIndication, &VideoService::onAVChannelStopIndication>,
+        On<VideoService, aasdk::proto::ids::AVChannelMessage::VIDEO_FOCUS_REQUEST,
+           aasdk::proto::messages::VideoFocusRequest, &VideoService::onVideoFocusRequest>
+    > Handlers;
+
+private:
+    void sendVideoFocusIndication();
+    void sendMediaAck();
+    void flushMediaAcks();
+
+    VideoDecoder &m_decoder;
+    ErrorHandler m_errorHandler;
+    int32_t m_session;
+
+    int m_frameRateLimit;
+    boost::asio::steady_timer m_ackTimer;
+    bool m_ackScheduled;
+    uint32_t m_pendingAcks;
+    std::chrono::steady_clock::time_point m_lastAck;
+};
+
+#endif // VIDEOSERVICE_H
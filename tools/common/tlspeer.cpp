@@ -0,0 +1,145 @@
+#include "tlspeer.h"
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+TlsPeer::TlsPeer()
+    : m_privateKey(nullptr),
+      m_certificate(nullptr),
+      m_context(nullptr),
+      m_ssl(nullptr),
+      m_readBio(nullptr),
+      m_writeBio(nullptr)
+{
+}
+
+TlsPeer::~TlsPeer()
+{
+    // SSL_free() also releases both BIOs
+    SSL_free(m_ssl);
+    SSL_CTX_free(m_context);
+    X509_free(m_certificate);
+    EVP_PKEY_free(m_privateKey);
+}
+
+bool TlsPeer::init()
+{
+    if (!generateCredentials()) {
+        return false;
+    }
+
+    m_context = SSL_CTX_new(TLS_server_method());
+    if (m_context == nullptr
+            || SSL_CTX_use_certificate(m_context, m_certificate) != 1
+            || SSL_CTX_use_PrivateKey(m_context, m_privateKey) != 1) {
+        return false;
+    }
+
+    m_ssl = SSL_new(m_context);
+    m_readBio = BIO_new(BIO_s_mem());
+    m_writeBio = BIO_new(BIO_s_mem());
+    if (m_ssl == nullptr || m_readBio == nullptr || m_writeBio == nullptr) {
+        return false;
+    }
+
+    SSL_set_bio(m_ssl, m_readBio, m_writeBio);
+    SSL_set_accept_state(m_ssl);
+    return true;
+}
+
+bool TlsPeer::handshake(const uint8_t *data, size_t size)
+{
+    if (size > 0) {
+        BIO_write(m_readBio, data, static_cast<int>(size));
+    }
+
+    const int result = SSL_do_handshake(m_ssl);
+    if (result == 1) {
+        return true;
+    }
+
+    const int error = SSL_get_error(m_ssl, result);
+    if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) {
+        ERR_clear_error();
+    }
+    return false;
+}
+
+bool TlsPeer::isEstablished() const
+{
+    return m_ssl != nullptr && SSL_is_init_finished(m_ssl);
+}
+
+std::vector<uint8_t> TlsPeer::takeOutput()
+{
+    std::vector<uint8_t> output(BIO_ctrl_pending(m_writeBio));
+    if (!output.empty()) {
+        const int read = BIO_read(m_writeBio, output.data(), static_cast<int>(output.size()));
+        output.resize(read > 0 ? read : 0);
+    }
+    return output;
+}
+
+bool TlsPeer::encrypt(const uint8_t *data, size_t size, std::vector<uint8_t> &record)
+{
+    if (SSL_write(m_ssl, data, static_cast<int>(size)) <= 0) {
+        return false;
+    }
+
+    record = takeOutput();
+    return true;
+}
+
+bool TlsPeer::decrypt(const uint8_t *data, size_t size, std::vector<uint8_t> &plain)
+{
+    BIO_write(m_readBio, data, static_cast<int>(size));
+
+    plain.clear();
+    uint8_t buffer[16 * 1024];
+    while (true) {
+        const int read = SSL_read(m_ssl, buffer, sizeof(buffer));
+        if (read <= 0) {
+            const int error = SSL_get_error(m_ssl, read);
+            return error == SSL_ERROR_WANT_READ;
+        }
+        plain.insert(plain.end(), buffer, buffer + read);
+    }
+}
+
+bool TlsPeer::generateCredentials()
+{
+    EVP_PKEY_CTX *keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    if (keyContext == nullptr) {
+        return false;
+    }
+
+    const bool generated = EVP_PKEY_keygen_init(keyContext) == 1
+            && EVP_PKEY_CTX_set_rsa_keygen_bits(keyContext, 2048) == 1
+            && EVP_PKEY_keygen(keyContext, &m_privateKey) == 1;
+    EVP_PKEY_CTX_free(keyContext);
+    if (!generated) {
+        return false;
+    }
+
+    m_certificate = X509_new();
+    if (m_certificate == nullptr) {
+        return false;
+    }
+
+    X509_set_version(m_certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(m_certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(m_certificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(m_certificate), 365L * 24 * 60 * 60);
+    X509_set_pubkey(m_certificate, m_privateKey);
+
+    X509_NAME *name = X509_get_subject_name(m_certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char*>("aaqt phone emulator"), -1, -1, 0);
+    X509_set_issuer_name(m_certificate, name);
+
+    return X509_sign(m_certificate, m_privateKey, EVP_sha256()) > 0;
+}
@@ -0,0 +1,53 @@
+#ifndef TLSPEER_H
+#define TLSPEER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct bio_st BIO;
+typedef struct evp_pkey_st EVP_PKEY;
+typedef struct x509_st X509;
+
+// Phone side of the TLS session carried in AAP handshake messages.
+//
+// The head unit's Cryptor is the TLS client; this is the matching server
+// with a freshly generated self-signed certificate, driven entirely through
+// memory BIOs so callers decide how the bytes travel.
+class TlsPeer
+{
+public:
+    TlsPeer();
+    ~TlsPeer();
+
+    TlsPeer(const TlsPeer &) = delete;
+    TlsPeer &operator=(const TlsPeer &) = delete;
+
+    bool init();
+
+    // Feeds handshake bytes from the head unit and advances the handshake.
+    // Returns true once the handshake has completed.
+    bool handshake(const uint8_t *data, size_t size);
+    bool isEstablished() const;
+
+    // Bytes OpenSSL wants to send to the head unit
+    std::vector<uint8_t> takeOutput();
+
+    // Produces one TLS record per call for payloads up to 16 KiB
+    bool encrypt(const uint8_t *data, size_t size, std::vector<uint8_t> &record);
+    bool decrypt(const uint8_t *data, size_t size, std::vector<uint8_t> &plain);
+
+private:
+    bool generateCredentials();
+
+    EVP_PKEY *m_privateKey;
+    X509 *m_certificate;
+    SSL_CTX *m_context;
+    SSL *m_ssl;
+    BIO *m_readBio;
+    BIO *m_writeBio;
+};
+
+#endif // TLSPEER_H
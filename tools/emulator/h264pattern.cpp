@@ -0,0 +1,118 @@
+#include "h264pattern.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+void drawPattern(AVFrame *frame, int index)
+{
+    // Diagonal luma ramp scrolling by a few pixels per frame plus chroma bands,
+    // enough motion to keep the encoder producing realistic P-frames
+    for (int y = 0; y < frame->height; ++y) {
+        uint8_t *line = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x) {
+            line[x] = static_cast<uint8_t>(x + y + index * 4);
+        }
+    }
+
+    for (int y = 0; y < frame->height / 2; ++y) {
+        uint8_t *u = frame->data[1] + y * frame->linesize[1];
+        uint8_t *v = frame->data[2] + y * frame->linesize[2];
+        for (int x = 0; x < frame->width / 2; ++x) {
+            const int band = ((x + index) / 64) & 7;
+            u[x] = static_cast<uint8_t>(64 + band * 16);
+            v[x] = static_cast<uint8_t>(192 - band * 16);
+        }
+    }
+}
+
+}
+
+bool H264Pattern::generate(const Config &config)
+{
+    m_accessUnits.clear();
+
+    const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+    if (codec == nullptr) {
+        codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+    if (codec == nullptr) {
+        m_errorString = "No H.264 encoder available in libavcodec";
+        return false;
+    }
+
+    AVCodecContext *context = avcodec_alloc_context3(codec);
+    context->width = config.width;
+    context->height = config.height;
+    context->time_base = AVRational{1, config.fps};
+    context->framerate = AVRational{config.fps, 1};
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->bit_rate = config.bitrate;
+    context->gop_size = config.fps;
+    // Phones stream without B-frames
+    context->max_b_frames = 0;
+
+    av_opt_set(context->priv_data, "profile", "baseline", 0);
+    av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(context->priv_data, "tune", "zerolatency", 0);
+
+    if (avcodec_open2(context, codec, nullptr) < 0) {
+        m_errorString = QString("Unable to open %1 for %2x%3").arg(codec->name).arg(config.width).arg(config.height);
+        avcodec_free_context(&context);
+        return false;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = config.width;
+    frame->height = config.height;
+    av_frame_get_buffer(frame, 0);
+
+    AVPacket *packet = av_packet_alloc();
+    const int frameCount = config.fps * config.seconds;
+
+    auto collect = [this, context, packet]() {
+        while (avcodec_receive_packet(context, packet) == 0) {
+            m_accessUnits.emplace_back(packet->data, packet->data + packet->size);
+            av_packet_unref(packet);
+        }
+    };
+
+    for (int index = 0; index < frameCount; ++index) {
+        av_frame_make_writable(frame);
+        drawPattern(frame, index);
+        frame->pts = index;
+        // The loop restarts here, so the first frame has to be an IDR
+        frame->pict_type = index == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+        avcodec_send_frame(context, frame);
+        collect();
+    }
+
+    avcodec_send_frame(context, nullptr);
+    collect();
+
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+
+    if (m_accessUnits.empty()) {
+        m_errorString = "Encoder produced no output";
+        return false;
+    }
+    return true;
+}
+
+const std::vector<std::vector<uint8_t>> &H264Pattern::accessUnits() const
+{
+    return m_accessUnits;
+}
+
+QString H264Pattern::errorString() const
+{
+    return m_errorString;
+}
@@ -0,0 +1,34 @@
+#ifndef H264PATTERN_H
+#define H264PATTERN_H
+
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+// Synthetic H.264 stream for the phone emulator. A short moving test pattern
+// is encoded once up front and replayed in a loop, so the emulator's own CPU
+// use does not depend on the encoder while it measures the head unit.
+class H264Pattern
+{
+public:
+    struct Config
+    {
+        int width = 1920;
+        int height = 1080;
+        int fps = 60;
+        int bitrate = 8000000;
+        // Length of the replayed loop; every loop starts with an IDR frame
+        int seconds = 2;
+    };
+
+    bool generate(const Config &config);
+
+    const std::vector<std::vector<uint8_t>> &accessUnits() const;
+    QString errorString() const;
+
+private:
+    std::vector<std::vector<uint8_t>> m_accessUnits;
+    QString m_errorString;
+};
+
+#endif // H264PATTERN_H
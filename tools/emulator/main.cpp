@@ -0,0 +1,150 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "h264pattern.h"
+#include "phoneemulator.h"
+
+// Stands in for a phone so the head unit can be load and soak tested without
+// hardware. Start it, then point AndroidAutoQt at it with --loopback.
+
+namespace {
+
+void printStats(QTextStream &out, const PhoneEmulator::Stats &stats, const PhoneEmulator::Stats &previous,
+                double seconds)
+{
+    const double fps = (stats.videoFramesSent - previous.videoFramesSent) / seconds;
+    const double mbps = (stats.videoBytesSent - previous.videoBytesSent) * 8 / seconds / 1e6;
+    out << QString("video %1 fps %2 Mbit/s acked %3 throttled %4 backlogged %5 | audio %6 | ping %7/%8 rtt %9 ms (max %10) | pending %11")
+               .arg(fps, 0, 'f', 1)
+               .arg(mbps, 0, 'f', 2)
+               .arg(stats.videoAcks)
+               .arg(stats.videoFramesThrottled)
+               .arg(stats.videoFramesBacklogged)
+               .arg(stats.audioPacketsSent)
+               .arg(stats.pingsAnswered)
+               .arg(stats.pingsSent)
+               .arg(stats.lastPingRttMs, 0, 'f', 2)
+               .arg(stats.maxPingRttMs, 0, 'f', 2)
+               .arg(stats.pendingSends)
+        << Qt::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("aaqt_phone_emulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Synthetic Android Auto phone for load and soak testing AndroidAutoQt");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"listen", "Address to listen on.", "address", "127.0.0.1"},
+        {"port", "TCP port to listen on.", "port", "5277"},
+        {"width", "Video width.", "pixels", "1920"},
+        {"height", "Video height.", "pixels", "1080"},
+        {"fps", "Video frame rate.", "fps", "60"},
+        {"bitrate", "Video bitrate in bits per second.", "bps", "8000000"},
+        {"audio-rate", "Audio packets per second, 0 disables audio.", "rate", "50"},
+        {"ping-rate", "Pings per second, 0 disables pings.", "rate", "1"},
+        {"max-unacked", "Video frames in flight; -1 uses the head unit's window, 0 ignores acks.", "frames", "-1"},
+        {"duration", "Seconds to stream before exiting, 0 runs until the head unit disconnects.", "seconds", "0"},
+    });
+    parser.process(app);
+
+    QTextStream out(stdout);
+
+    H264Pattern::Config patternConfig;
+    patternConfig.width = parser.value("width").toInt();
+    patternConfig.height = parser.value("height").toInt();
+    patternConfig.fps = parser.value("fps").toInt();
+    patternConfig.bitrate = parser.value("bitrate").toInt();
+    if (patternConfig.width <= 0 || patternConfig.height <= 0 || patternConfig.fps <= 0 || patternConfig.bitrate <= 0) {
+        qCritical() << "Video size, fps and bitrate must be positive";
+        return 2;
+    }
+
+    H264Pattern pattern;
+    if (!pattern.generate(patternConfig)) {
+        qCritical() << "Unable to generate the video pattern:" << pattern.errorString();
+        return 2;
+    }
+    out << QString("Encoded %1 frames of %2x%3 at %4 fps").arg(pattern.accessUnits().size())
+               .arg(patternConfig.width).arg(patternConfig.height).arg(patternConfig.fps) << Qt::endl;
+
+    PhoneEmulator::Config config;
+    config.listenAddress = parser.value("listen");
+    config.port = static_cast<quint16>(parser.value("port").toUInt());
+    config.videoFps = patternConfig.fps;
+    config.audioPacketsPerSecond = parser.value("audio-rate").toInt();
+    config.pingsPerSecond = parser.value("ping-rate").toInt();
+    config.maxUnacked = parser.value("max-unacked").toInt();
+    const int duration = parser.value("duration").toInt();
+
+    boost::asio::io_service ioService;
+    auto emulator = std::make_shared<PhoneEmulator>(ioService, config, pattern);
+
+    int exitCode = 0;
+    bool durationElapsed = false;
+    boost::asio::steady_timer statsTimer(ioService);
+    boost::asio::steady_timer durationTimer(ioService);
+
+    emulator->setFinishedHandler([&](bool clean, const QString &reason) {
+        const PhoneEmulator::Stats stats = emulator->stats();
+        out << "Finished: " << reason << Qt::endl;
+        out << QString("Sent %1 video frames, %2 acked, %3 audio packets; %4 of %5 pings answered, max rtt %6 ms")
+                   .arg(stats.videoFramesSent).arg(stats.videoAcks).arg(stats.audioPacketsSent)
+                   .arg(stats.pingsAnswered).arg(stats.pingsSent).arg(stats.maxPingRttMs, 0, 'f', 2) << Qt::endl;
+
+        // A duration run must last the whole duration, so an early disconnect fails it
+        const bool completed = duration > 0 ? durationElapsed : clean;
+        exitCode = completed && stats.established ? 0 : 1;
+        statsTimer.cancel();
+        durationTimer.cancel();
+        ioService.post([&ioService]() { ioService.stop(); });
+    });
+
+    try {
+        emulator->listen();
+    }
+    catch (const std::exception &ex) {
+        qCritical() << "Unable to listen:" << ex.what();
+        return 2;
+    }
+
+    PhoneEmulator::Stats previous;
+    std::function<void()> scheduleStats = [&]() {
+        statsTimer.expires_from_now(std::chrono::seconds(1));
+        statsTimer.async_wait([&](const boost::system::error_code &ec) {
+            if (ec) {
+                return;
+            }
+            const PhoneEmulator::Stats stats = emulator->stats();
+            if (stats.established) {
+                printStats(out, stats, previous, 1.0);
+            }
+            previous = stats;
+            scheduleStats();
+        });
+    };
+    scheduleStats();
+
+    if (duration > 0) {
+        durationTimer.expires_from_now(std::chrono::seconds(duration));
+        durationTimer.async_wait([&](const boost::system::error_code &ec) {
+            if (!ec) {
+                durationElapsed = true;
+                emulator->stop();
+            }
+        });
+    }
+
+    ioService.run();
+    return exitCode;
+}
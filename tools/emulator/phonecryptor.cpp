@@ -0,0 +1,76 @@
+#include "phonecryptor.h"
+
+#include <aasdk/Error/Error.hpp>
+
+PhoneCryptor::PhoneCryptor()
+    : m_initialized(false)
+{
+}
+
+void PhoneCryptor::init()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_initialized) {
+        if (!m_peer.init()) {
+            throw aasdk::error::Error(aasdk::error::ErrorCode::SSL_CONTEXT_CREATION);
+        }
+        m_initialized = true;
+    }
+}
+
+void PhoneCryptor::deinit()
+{
+}
+
+bool PhoneCryptor::doHandshake()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const bool done = m_peer.handshake(m_pendingHandshake.data(), m_pendingHandshake.size());
+    m_pendingHandshake.clear();
+    return done;
+}
+
+size_t PhoneCryptor::encrypt(aasdk::common::Data& output, const aasdk::common::DataConstBuffer& buffer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<uint8_t> record;
+    if (!m_peer.encrypt(buffer.cdata, buffer.size, record)) {
+        throw aasdk::error::Error(aasdk::error::ErrorCode::SSL_WRITE);
+    }
+
+    output.insert(output.end(), record.begin(), record.end());
+    return record.size();
+}
+
+size_t PhoneCryptor::decrypt(aasdk::common::Data& output, const aasdk::common::DataConstBuffer& buffer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<uint8_t> plain;
+    if (!m_peer.decrypt(buffer.cdata, buffer.size, plain)) {
+        throw aasdk::error::Error(aasdk::error::ErrorCode::SSL_READ);
+    }
+
+    output.insert(output.end(), plain.begin(), plain.end());
+    return plain.size();
+}
+
+aasdk::common::Data PhoneCryptor::readHandshakeBuffer()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peer.takeOutput();
+}
+
+void PhoneCryptor::writeHandshakeBuffer(const aasdk::common::DataConstBuffer& buffer)
+{
+    // Consumed by the next doHandshake(), mirroring the head unit's Cryptor
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pendingHandshake.insert(m_pendingHandshake.end(), buffer.cdata, buffer.cdata + buffer.size);
+}
+
+bool PhoneCryptor::isActive() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peer.isEstablished();
+}
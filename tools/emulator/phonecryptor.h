@@ -0,0 +1,33 @@
+#ifndef PHONECRYPTOR_H
+#define PHONECRYPTOR_H
+
+#include <mutex>
+
+#include <aasdk/Messenger/ICryptor.hpp>
+
+#include "tlspeer.h"
+
+// ICryptor for the phone end of the link: the TLS server counterpart of the
+// head unit's aasdk Cryptor, so the emulator can reuse aasdk's messenger.
+class PhoneCryptor : public aasdk::messenger::ICryptor
+{
+public:
+    PhoneCryptor();
+
+    void init() override;
+    void deinit() override;
+    bool doHandshake() override;
+    size_t encrypt(aasdk::common::Data& output, const aasdk::common::DataConstBuffer& buffer) override;
+    size_t decrypt(aasdk::common::Data& output, const aasdk::common::DataConstBuffer& buffer) override;
+    aasdk::common::Data readHandshakeBuffer() override;
+    void writeHandshakeBuffer(const aasdk::common::DataConstBuffer& buffer) override;
+    bool isActive() const override;
+
+private:
+    mutable std::mutex m_mutex;
+    TlsPeer m_peer;
+    aasdk::common::Data m_pendingHandshake;
+    bool m_initialized;
+};
+
+#endif // PHONECRYPTOR_H
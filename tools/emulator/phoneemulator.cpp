@@ -0,0 +1,535 @@
+#include "phoneemulator.h"
+#include "phonecryptor.h"
+#include <QDebug>
+#include <cmath>
+
+#include <aasdk/TCP/TCPEndpoint.hpp>
+#include <aasdk/Transport/TCPTransport.hpp>
+#include <aasdk/Messenger/MessageInStream.hpp>
+#include <aasdk/Messenger/MessageOutStream.hpp>
+#include <aasdk/Messenger/Messenger.hpp>
+#include <aasdk/Messenger/MessageId.hpp>
+#include <aasdk/Messenger/Timestamp.hpp>
+#include <aasdk/IO/Promise.hpp>
+#include <aasdk/Error/Error.hpp>
+
+#include <aasdk_proto/ControlMessageIdsEnum.pb.h>
+#include <aasdk_proto/AVChannelMessageIdsEnum.pb.h>
+#include <aasdk_proto/VersionResponseStatusEnum.pb.h>
+#include <aasdk_proto/ServiceDiscoveryRequestMessage.pb.h>
+#include <aasdk_proto/ServiceDiscoveryResponseMessage.pb.h>
+#include <aasdk_proto/ChannelOpenRequestMessage.pb.h>
+#include <aasdk_proto/ChannelOpenResponseMessage.pb.h>
+#include <aasdk_proto/AVChannelSetupRequestMessage.pb.h>
+#include <aasdk_proto/AVChannelSetupResponseMessage.pb.h>
+#include <aasdk_proto/AVChannelStartIndicationMessage.pb.h>
+#include <aasdk_proto/AVMediaAckIndicationMessage.pb.h>
+#include <aasdk_proto/PingRequestMessage.pb.h>
+#include <aasdk_proto/PingResponseMessage.pb.h>
+
+namespace {
+
+const int cAudioSampleRate = 48000;
+const int cAudioBytesPerFrame = 4;
+// Pings left unanswered beyond this are dropped from RTT matching
+const size_t cMaxPingsInFlight = 1000;
+
+void appendUint16(aasdk::common::Data &data, uint16_t value)
+{
+    data.push_back(static_cast<uint8_t>(value >> 8));
+    data.push_back(static_cast<uint8_t>(value & 0xff));
+}
+
+uint64_t microsecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+PhoneEmulator::PhoneEmulator(boost::asio::io_service &ioService, const Config &config, const H264Pattern &pattern)
+    : m_ioService(ioService),
+      m_config(config),
+      m_pattern(pattern),
+      m_pingTimer(ioService),
+      m_running(false)
+{
+    m_video.channelId = aasdk::messenger::ChannelId::VIDEO;
+    m_video.timer.reset(new boost::asio::steady_timer(ioService));
+    m_audio.channelId = aasdk::messenger::ChannelId::MEDIA_AUDIO;
+    m_audio.timer.reset(new boost::asio::steady_timer(ioService));
+
+    // One packet of a 1 kHz tone, replayed for every audio tick
+    if (m_config.audioPacketsPerSecond > 0) {
+        const int frames = cAudioSampleRate / m_config.audioPacketsPerSecond;
+        m_audioPayload.reserve(frames * cAudioBytesPerFrame);
+        for (int i = 0; i < frames; ++i) {
+            const int16_t sample = static_cast<int16_t>(8000 * std::sin(2 * M_PI * 1000 * i / cAudioSampleRate));
+            for (int channel = 0; channel < 2; ++channel) {
+                m_audioPayload.push_back(static_cast<uint8_t>(sample & 0xff));
+                m_audioPayload.push_back(static_cast<uint8_t>((sample >> 8) & 0xff));
+            }
+        }
+    }
+}
+
+PhoneEmulator::~PhoneEmulator()
+{
+}
+
+void PhoneEmulator::setFinishedHandler(FinishedHandler handler)
+{
+    m_finishedHandler = std::move(handler);
+}
+
+void PhoneEmulator::listen()
+{
+    const boost::asio::ip::tcp::endpoint endpoint(
+        boost::asio::ip::address::from_string(m_config.listenAddress.toStdString()), m_config.port);
+    m_acceptor.reset(new boost::asio::ip::tcp::acceptor(m_ioService, endpoint));
+    m_running = true;
+
+    qDebug() << "Waiting for a head unit on" << m_config.listenAddress << m_config.port;
+
+    auto socket = std::make_shared<boost::asio::ip::tcp::socket>(m_ioService);
+    m_acceptor->async_accept(*socket, [this, self = this->shared_from_this(), socket](const boost::system::error_code &ec) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted) {
+                finish(false, QString("Accept failed: %1").arg(QString::fromStdString(ec.message())));
+            }
+            return;
+        }
+
+        m_acceptor->close();
+        socket->set_option(boost::asio::ip::tcp::no_delay(true));
+        qDebug() << "Head unit connected from" << QString::fromStdString(socket->remote_endpoint().address().to_string());
+
+        auto tcpEndpoint = std::make_shared<aasdk::tcp::TCPEndpoint>(m_tcpWrapper, socket);
+        startSession(std::make_shared<aasdk::transport::TCPTransport>(m_ioService, tcpEndpoint));
+    });
+}
+
+void PhoneEmulator::startSession(aasdk::transport::ITransport::Pointer transport)
+{
+    m_running = true;
+    m_connectedAt = std::chrono::steady_clock::now();
+    m_transport = std::move(transport);
+
+    try {
+        m_cryptor = std::make_shared<PhoneCryptor>();
+        m_cryptor->init();
+    }
+    catch (const aasdk::error::Error &e) {
+        finish(false, QString("TLS setup failed: %1").arg(e.what()));
+        return;
+    }
+
+    auto inStream = std::make_shared<aasdk::messenger::MessageInStream>(m_ioService, m_transport, m_cryptor);
+    auto outStream = std::make_shared<aasdk::messenger::MessageOutStream>(m_ioService, m_transport, m_cryptor);
+    m_messenger = std::make_shared<aasdk::messenger::Messenger>(m_ioService, inStream, outStream);
+
+    auto startPromise = aasdk::io::PromisePtr<void>(
+        new aasdk::io::Promise<void>(
+            []() {},
+            [this, self = this->shared_from_this()](const aasdk::error::Error &e) {
+                finish(false, QString("Transport failed to start: %1").arg(e.what()));
+            }
+        )
+    );
+
+    m_transport->start(startPromise);
+
+    // The head unit opens with a version request
+    receive(aasdk::messenger::ChannelId::CONTROL);
+}
+
+void PhoneEmulator::stop()
+{
+    finish(true, "Stopped");
+}
+
+PhoneEmulator::Stats PhoneEmulator::stats() const
+{
+    return m_stats;
+}
+
+void PhoneEmulator::receive(aasdk::messenger::ChannelId channelId)
+{
+    auto receivePromise = aasdk::io::PromisePtr<aasdk::messenger::Message::Pointer>(
+        new aasdk::io::Promise<aasdk::messenger::Message::Pointer>(
+            [this, self = this->shared_from_this(), channelId](aasdk::messenger::Message::Pointer message) {
+                onMessage(channelId, std::move(message));
+            },
+            [this, self = this->shared_from_this()](const aasdk::error::Error &e) {
+                // An aborted receive means the head unit closed the link
+                if (e.getCode() == aasdk::error::ErrorCode::OPERATION_ABORTED) {
+                    finish(true, "Head unit disconnected");
+                } else {
+                    finish(false, QString("Receive failed: %1").arg(e.what()));
+                }
+            }
+        )
+    );
+
+    m_messenger->enqueueReceive(channelId, receivePromise);
+}
+
+void PhoneEmulator::onMessage(aasdk::messenger::ChannelId channelId, aasdk::messenger::Message::Pointer message)
+{
+    if (!m_running) {
+        return;
+    }
+
+    const aasdk::common::Data &payload = message->getPayload();
+    if (payload.size() < aasdk::messenger::MessageId::getSizeOf()) {
+        qWarning() << "Dropping truncated message on channel" << static_cast<int>(channelId);
+        receive(channelId);
+        return;
+    }
+
+    const aasdk::messenger::MessageId messageId(payload);
+    const aasdk::common::DataConstBuffer body(payload, aasdk::messenger::MessageId::getSizeOf());
+
+    try {
+        if (channelId == aasdk::messenger::ChannelId::CONTROL) {
+            onControlMessage(messageId.getId(), body);
+        } else if (channelId == m_video.channelId) {
+            onAVMessage(m_video, messageId.getId(), body);
+        } else if (channelId == m_audio.channelId) {
+            onAVMessage(m_audio, messageId.getId(), body);
+        }
+    }
+    catch (const std::exception &ex) {
+        finish(false, QString("Protocol error: %1").arg(ex.what()));
+        return;
+    }
+
+    if (m_running) {
+        receive(channelId);
+    }
+}
+
+void PhoneEmulator::onControlMessage(uint16_t messageId, const aasdk::common::DataConstBuffer &payload)
+{
+    using aasdk::messenger::ChannelId;
+    using aasdk::messenger::EncryptionType;
+    using aasdk::messenger::MessageType;
+
+    switch (messageId) {
+    case aasdk::proto::ids::ControlMessage::VERSION_REQUEST: {
+        qDebug() << "Version request received";
+        aasdk::common::Data response;
+        appendUint16(response, 1);
+        appendUint16(response, 1);
+        appendUint16(response, aasdk::proto::enums::VersionResponseStatus::MATCH);
+        send(ChannelId::CONTROL, EncryptionType::PLAIN, MessageType::SPECIFIC,
+             aasdk::proto::ids::ControlMessage::VERSION_RESPONSE, response);
+        break;
+    }
+    case aasdk::proto::ids::ControlMessage::SSL_HANDSHAKE: {
+        m_cryptor->writeHandshakeBuffer(payload);
+        m_cryptor->doHandshake();
+        const aasdk::common::Data output = m_cryptor->readHandshakeBuffer();
+        if (!output.empty()) {
+            send(ChannelId::CONTROL, EncryptionType::PLAIN, MessageType::SPECIFIC,
+                 aasdk::proto::ids::ControlMessage::SSL_HANDSHAKE, output);
+        }
+        break;
+    }
+    case aasdk::proto::ids::ControlMessage::AUTH_COMPLETE: {
+        m_stats.established = true;
+        m_stats.timeToEstablished = std::chrono::microseconds(microsecondsSince(m_connectedAt));
+        qDebug() << "Authenticated after" << m_stats.timeToEstablished.count() / 1000.0 << "ms";
+
+        aasdk::proto::messages::ServiceDiscoveryRequest request;
+        request.set_device_name("aaqt phone emulator");
+        request.set_device_brand("aaqt");
+        send(ChannelId::CONTROL, MessageType::SPECIFIC,
+             aasdk::proto::ids::ControlMessage::SERVICE_DISCOVERY_REQUEST, request);
+        break;
+    }
+    case aasdk::proto::ids::ControlMessage::SERVICE_DISCOVERY_RESPONSE: {
+        aasdk::proto::messages::ServiceDiscoveryResponse response;
+        if (!response.ParseFromArray(payload.cdata, payload.size)) {
+            throw std::runtime_error("Malformed service discovery response");
+        }
+
+        bool hasVideo = false;
+        bool hasAudio = false;
+        for (const auto &descriptor : response.channel_descriptors()) {
+            hasVideo |= descriptor.channel_id() == static_cast<uint32_t>(m_video.channelId);
+            hasAudio |= descriptor.channel_id() == static_cast<uint32_t>(m_audio.channelId);
+        }
+        qDebug() << "Service discovery:" << response.channel_descriptors_size() << "channels";
+
+        if (hasVideo) {
+            openChannel(m_video);
+        } else {
+            qWarning() << "Head unit does not advertise a video channel";
+        }
+
+        if (m_config.audioPacketsPerSecond > 0) {
+            if (hasAudio) {
+                openChannel(m_audio);
+            } else {
+                qWarning() << "Head unit does not advertise a media audio channel, not sending audio";
+            }
+        }
+
+        schedulePing();
+        break;
+    }
+    case aasdk::proto::ids::ControlMessage::PING_REQUEST: {
+        aasdk::proto::messages::PingRequest request;
+        request.ParseFromArray(payload.cdata, payload.size);
+
+        aasdk::proto::messages::PingResponse response;
+        response.set_timestamp(request.timestamp());
+        send(ChannelId::CONTROL, MessageType::SPECIFIC, aasdk::proto::ids::ControlMessage::PING_RESPONSE, response);
+        break;
+    }
+    case aasdk::proto::ids::ControlMessage::PING_RESPONSE: {
+        if (!m_pingsInFlight.empty()) {
+            const double rttMs = microsecondsSince(m_pingsInFlight.front()) / 1000.0;
+            m_pingsInFlight.pop_front();
+            ++m_stats.pingsAnswered;
+            m_stats.lastPingRttMs = rttMs;
+            m_stats.maxPingRttMs = std::max(m_stats.maxPingRttMs, rttMs);
+        }
+        break;
+    }
+    default:
+        qDebug() << "Ignoring control message" << messageId;
+        break;
+    }
+}
+
+void PhoneEmulator::onAVMessage(Stream &stream, uint16_t messageId, const aasdk::common::DataConstBuffer &payload)
+{
+    switch (messageId) {
+    case aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_RESPONSE: {
+        aasdk::proto::messages::ChannelOpenResponse response;
+        response.ParseFromArray(payload.cdata, payload.size);
+        if (response.status() != aasdk::proto::enums::Status::OK) {
+            throw std::runtime_error("Head unit refused to open an AV channel");
+        }
+
+        aasdk::proto::messages::AVChannelSetupRequest request;
+        request.set_config_index(0);
+        send(stream.channelId, aasdk::messenger::MessageType::SPECIFIC,
+             aasdk::proto::ids::AVChannelMessage::SETUP_REQUEST, request);
+        break;
+    }
+    case aasdk::proto::ids::AVChannelMessage::SETUP_RESPONSE: {
+        aasdk::proto::messages::AVChannelSetupResponse response;
+        response.ParseFromArray(payload.cdata, payload.size);
+        stream.maxUnacked = m_config.maxUnacked < 0 ? static_cast<int>(response.max_unacked()) : m_config.maxUnacked;
+
+        aasdk::proto::messages::AVChannelStartIndication indication;
+        indication.set_session(0);
+        indication.set_config(0);
+        send(stream.channelId, aasdk::messenger::MessageType::SPECIFIC,
+             aasdk::proto::ids::AVChannelMessage::START_INDICATION, indication);
+
+        qDebug() << "Streaming on channel" << static_cast<int>(stream.channelId) << "max unacked" << stream.maxUnacked;
+        stream.started = true;
+        stream.startedAt = std::chrono::steady_clock::now();
+        stream.timer->expires_at(stream.startedAt);
+        const int rate = &stream == &m_video ? m_config.videoFps : m_config.audioPacketsPerSecond;
+        scheduleStream(stream, std::chrono::microseconds(1000000 / rate));
+        break;
+    }
+    case aasdk::proto::ids::AVChannelMessage::AV_MEDIA_ACK_INDICATION: {
+        aasdk::proto::messages::AVMediaAckIndication indication;
+        indication.ParseFromArray(payload.cdata, payload.size);
+        const int acked = std::max<int>(1, indication.value());
+        stream.unacked = std::max(0, stream.unacked - acked);
+        if (&stream == &m_video) {
+            m_stats.videoAcks += acked;
+        }
+        break;
+    }
+    default:
+        qDebug() << "Ignoring AV message" << messageId << "on channel" << static_cast<int>(stream.channelId);
+        break;
+    }
+}
+
+void PhoneEmulator::send(aasdk::messenger::ChannelId channelId, aasdk::messenger::EncryptionType encryption,
+                         aasdk::messenger::MessageType messageType, uint16_t messageId, const aasdk::common::Data &payload)
+{
+    auto message = std::make_shared<aasdk::messenger::Message>(channelId, encryption, messageType);
+    message->insertPayload(aasdk::messenger::MessageId(messageId).getData());
+    message->insertPayload(payload);
+
+    ++m_stats.pendingSends;
+    auto sendPromise = aasdk::io::PromisePtr<void>(
+        new aasdk::io::Promise<void>(
+            [this, self = this->shared_from_this()]() {
+                --m_stats.pendingSends;
+            },
+            [this, self = this->shared_from_this()](const aasdk::error::Error &e) {
+                --m_stats.pendingSends;
+                if (m_running) {
+                    finish(false, QString("Send failed: %1").arg(e.what()));
+                }
+            }
+        )
+    );
+
+    m_messenger->enqueueSend(std::move(message), sendPromise);
+}
+
+void PhoneEmulator::send(aasdk::messenger::ChannelId channelId, aasdk::messenger::MessageType messageType,
+                         uint16_t messageId, const google::protobuf::Message &message)
+{
+    aasdk::common::Data payload(message.ByteSize());
+    message.SerializeToArray(payload.data(), payload.size());
+    send(channelId, aasdk::messenger::EncryptionType::ENCRYPTED, messageType, messageId, payload);
+}
+
+void PhoneEmulator::openChannel(Stream &stream)
+{
+    aasdk::proto::messages::ChannelOpenRequest request;
+    request.set_priority(0);
+    request.set_channel_id(static_cast<uint32_t>(stream.channelId));
+    send(stream.channelId, aasdk::messenger::MessageType::CONTROL,
+         aasdk::proto::ids::ControlMessage::CHANNEL_OPEN_REQUEST, request);
+
+    // The messenger holds the head unit's replies on this channel until a receive is queued
+    receive(stream.channelId);
+}
+
+void PhoneEmulator::scheduleStream(Stream &stream, std::chrono::microseconds period)
+{
+    // Fixed deadlines keep the average rate exact; after a long stall the
+    // schedule restarts instead of bursting to catch up
+    const auto now = std::chrono::steady_clock::now();
+    auto deadline = stream.timer->expires_at() + period;
+    if (deadline + std::chrono::seconds(1) < now) {
+        deadline = now;
+    }
+    stream.timer->expires_at(deadline);
+
+    stream.timer->async_wait([this, self = this->shared_from_this(), &stream, period](const boost::system::error_code &ec) {
+        if (ec || !m_running) {
+            return;
+        }
+
+        if (&stream == &m_video) {
+            sendVideoFrame();
+        } else {
+            sendAudioPacket();
+        }
+        scheduleStream(stream, period);
+    });
+}
+
+void PhoneEmulator::sendVideoFrame()
+{
+    // A throttled tick repeats the same access unit next time rather than
+    // skipping it, so the stream stays decodable and the frame rate drops
+    if (m_video.maxUnacked > 0 && m_video.unacked >= m_video.maxUnacked) {
+        ++m_stats.videoFramesThrottled;
+        return;
+    }
+    if (m_stats.pendingSends > m_config.videoFps) {
+        ++m_stats.videoFramesBacklogged;
+        return;
+    }
+
+    const auto &units = m_pattern.accessUnits();
+    const std::vector<uint8_t> &unit = units[m_video.nextUnit];
+    m_video.nextUnit = (m_video.nextUnit + 1) % units.size();
+
+    aasdk::common::Data payload = aasdk::messenger::Timestamp(microsecondsSince(m_video.startedAt)).getData();
+    payload.insert(payload.end(), unit.begin(), unit.end());
+    send(m_video.channelId, aasdk::messenger::EncryptionType::ENCRYPTED, aasdk::messenger::MessageType::SPECIFIC,
+         aasdk::proto::ids::AVChannelMessage::AV_MEDIA_WITH_TIMESTAMP_INDICATION, payload);
+
+    ++m_video.unacked;
+    ++m_stats.videoFramesSent;
+    m_stats.videoBytesSent += unit.size();
+}
+
+void PhoneEmulator::sendAudioPacket()
+{
+    if (m_audio.maxUnacked > 0 && m_audio.unacked >= m_audio.maxUnacked) {
+        return;
+    }
+
+    aasdk::common::Data payload = aasdk::messenger::Timestamp(microsecondsSince(m_audio.startedAt)).getData();
+    payload.insert(payload.end(), m_audioPayload.begin(), m_audioPayload.end());
+    send(m_audio.channelId, aasdk::messenger::EncryptionType::ENCRYPTED, aasdk::messenger::MessageType::SPECIFIC,
+         aasdk::proto::ids::AVChannelMessage::AV_MEDIA_WITH_TIMESTAMP_INDICATION, payload);
+
+    ++m_audio.unacked;
+    ++m_stats.audioPacketsSent;
+}
+
+void PhoneEmulator::schedulePing()
+{
+    if (m_config.pingsPerSecond <= 0) {
+        return;
+    }
+
+    m_pingTimer.expires_from_now(std::chrono::microseconds(1000000 / m_config.pingsPerSecond));
+    m_pingTimer.async_wait([this, self = this->shared_from_this()](const boost::system::error_code &ec) {
+        if (ec || !m_running) {
+            return;
+        }
+
+        aasdk::proto::messages::PingRequest request;
+        request.set_timestamp(microsecondsSince(m_connectedAt));
+        send(aasdk::messenger::ChannelId::CONTROL, aasdk::messenger::MessageType::SPECIFIC,
+             aasdk::proto::ids::ControlMessage::PING_REQUEST, request);
+
+        m_pingsInFlight.push_back(std::chrono::steady_clock::now());
+        if (m_pingsInFlight.size() > cMaxPingsInFlight) {
+            m_pingsInFlight.pop_front();
+        }
+        ++m_stats.pingsSent;
+        schedulePing();
+    });
+}
+
+void PhoneEmulator::finish(bool clean, const QString &reason)
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+
+    if (clean) {
+        qDebug() << "Session finished:" << reason;
+    } else {
+        qWarning() << "Session failed:" << reason;
+    }
+
+    m_video.timer->cancel();
+    m_audio.timer->cancel();
+    m_pingTimer.cancel();
+
+    if (m_acceptor != nullptr) {
+        boost::system::error_code ec;
+        m_acceptor->close(ec);
+    }
+
+    if (m_messenger != nullptr) {
+        m_messenger->stop();
+    }
+
+    if (m_transport != nullptr) {
+        auto stopPromise = aasdk::io::PromisePtr<void>(
+            new aasdk::io::Promise<void>(
+                []() {},
+                [](const aasdk::error::Error&) {}
+            )
+        );
+        m_transport->stop(stopPromise);
+    }
+
+    if (m_finishedHandler) {
+        m_finishedHandler(clean, reason);
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef PHONEEMULATOR_H
+#define PHONEEMULATOR_H
+
+#include <QString>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+
+#include <aasdk/Messenger/IMessenger.hpp>
+#include <aasdk/Messenger/Message.hpp>
+#include <aasdk/Transport/ITransport.hpp>
+#include <aasdk/TCP/TCPWrapper.hpp>
+
+#include "h264pattern.h"
+
+class PhoneCryptor;
+
+// Plays the phone side of an Android Auto session against a head unit over
+// any aasdk transport: version exchange, TLS handshake, service discovery,
+// then a synthetic video stream, audio packets and pings at fixed rates.
+// Not thread safe: everything runs on the io_service passed in.
+class PhoneEmulator : public std::enable_shared_from_this<PhoneEmulator>
+{
+public:
+    typedef std::shared_ptr<PhoneEmulator> Pointer;
+    typedef std::function<void(bool clean, const QString &reason)> FinishedHandler;
+
+    struct Config
+    {
+        QString listenAddress = "127.0.0.1";
+        quint16 port = 5277;
+        // Rate the encoded pattern is sent at, normally the rate it was encoded for
+        int videoFps = 60;
+        // 48 kHz stereo PCM split into this many packets per second, 0 disables audio
+        int audioPacketsPerSecond = 50;
+        // 0 disables pings
+        int pingsPerSecond = 1;
+        // -1 honours the window from the head unit's setup response, 0 ignores acks
+        int maxUnacked = -1;
+    };
+
+    struct Stats
+    {
+        bool established = false;
+        std::chrono::microseconds timeToEstablished{0};
+        quint64 videoFramesSent = 0;
+        quint64 videoBytesSent = 0;
+        quint64 videoFramesThrottled = 0;
+        quint64 videoAcks = 0;
+        quint64 audioPacketsSent = 0;
+        quint64 pingsSent = 0;
+        quint64 pingsAnswered = 0;
+        double lastPingRttMs = 0;
+        double maxPingRttMs = 0;
+        // Sends handed to the messenger but not yet written to the transport
+        int pendingSends = 0;
+        // Ticks skipped because the head unit fell a second or more behind
+        quint64 videoFramesBacklogged = 0;
+    };
+
+    PhoneEmulator(boost::asio::io_service &ioService, const Config &config, const H264Pattern &pattern);
+    ~PhoneEmulator();
+
+    void setFinishedHandler(FinishedHandler handler);
+
+    // Listens on the configured TCP address and runs a session for the first head unit
+    void listen();
+    // Runs a session over a transport that is already connected
+    void startSession(aasdk::transport::ITransport::Pointer transport);
+    void stop();
+
+    Stats stats() const;
+
+private:
+    struct Stream
+    {
+        aasdk::messenger::ChannelId channelId;
+        bool started = false;
+        int maxUnacked = 1;
+        int unacked = 0;
+        size_t nextUnit = 0;
+        std::chrono::steady_clock::time_point startedAt;
+        std::unique_ptr<boost::asio::steady_timer> timer;
+    };
+
+    void receive(aasdk::messenger::ChannelId channelId);
+    void onMessage(aasdk::messenger::ChannelId channelId, aasdk::messenger::Message::Pointer message);
+    void onControlMessage(uint16_t messageId, const aasdk::common::DataConstBuffer &payload);
+    void onAVMessage(Stream &stream, uint16_t messageId, const aasdk::common::DataConstBuffer &payload);
+
+    void send(aasdk::messenger::ChannelId channelId, aasdk::messenger::EncryptionType encryption,
+              aasdk::messenger::MessageType messageType, uint16_t messageId, const aasdk::common::Data &payload);
+    void send(aasdk::messenger::ChannelId channelId, aasdk::messenger::MessageType messageType,
+              uint16_t messageId, const google::protobuf::Message &message);
+
+    void openChannel(Stream &stream);
+    void scheduleStream(Stream &stream, std::chrono::microseconds period);
+    void sendVideoFrame();
+    void sendAudioPacket();
+    void schedulePing();
+    void finish(bool clean, const QString &reason);
+
+    boost::asio::io_service &m_ioService;
+    const Config m_config;
+    const H264Pattern &m_pattern;
+
+    aasdk::tcp::TCPWrapper m_tcpWrapper;
+    std::unique_ptr<boost::asio::ip::tcp::acceptor> m_acceptor;
+    aasdk::transport::ITransport::Pointer m_transport;
+    std::shared_ptr<PhoneCryptor> m_cryptor;
+    aasdk::messenger::IMessenger::Pointer m_messenger;
+
+    Stream m_video;
+    Stream m_audio;
+    boost::asio::steady_timer m_pingTimer;
+    aasdk::common::Data m_audioPayload;
+
+    Stats m_stats;
+    std::chrono::steady_clock::time_point m_connectedAt;
+    std::deque<std::chrono::steady_clock::time_point> m_pingsInFlight;
+    FinishedHandler m_finishedHandler;
+    bool m_running;
+};
+
+#endif // PHONEEMULATOR_H
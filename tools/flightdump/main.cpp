@@ -0,0 +1,220 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "flightrecord.h"
+
+// Prints a flight recorder file as a timeline. Each line carries the wall
+// clock time, the gap to the previous event and the recording thread; frames
+// are followed through submit, decode and present so a stall can be pinned
+// on the stage that held it. Works on files left behind by a crash.
+
+namespace {
+
+QString wallClock(const FlightHeader &header, int64_t timestampNs)
+{
+    const int64_t wallNs = header.wallClockNs + (timestampNs - header.monotonicNs);
+    const QDateTime time = QDateTime::fromMSecsSinceEpoch(wallNs / 1000000);
+    return time.toString("yyyy-MM-dd hh:mm:ss.zzz") + QString("%1").arg((wallNs / 1000) % 1000, 3, 10, QChar('0'));
+}
+
+QString describe(const FlightRecord &record)
+{
+    switch (static_cast<FlightEvent>(record.event)) {
+    case FlightEvent::Start:
+        return QString("pid %1").arg(record.a);
+    case FlightEvent::Stall:
+        return QString("%1 stuck for %2 ms").arg(flightStageName(record.a)).arg(record.b);
+    case FlightEvent::StallEnd:
+        return QString("%1 resumed after %2 ms").arg(flightStageName(record.a)).arg(record.b);
+    case FlightEvent::SessionStart:
+    case FlightEvent::SessionStop:
+        return QString("generation %1").arg(record.a);
+    case FlightEvent::TeardownStalled:
+        return QString("not idle after %1 ms").arg(record.a);
+    case FlightEvent::MessageIn:
+    case FlightEvent::MessageOut:
+        return QString("channel %1 id 0x%2 %3 bytes").arg(record.channel)
+            .arg(record.a, 4, 16, QChar('0')).arg(record.b);
+    case FlightEvent::Error:
+        return QString("code %1 native %2 %3").arg(record.a).arg(record.b).arg(QString::fromUtf8(record.text));
+    case FlightEvent::UsbAttached:
+    case FlightEvent::UsbDetached:
+        return QString::fromUtf8(record.text);
+    case FlightEvent::FrameSubmitted:
+        return QString("pts %1 %2 bytes").arg(record.a).arg(record.b);
+    case FlightEvent::FrameDecoded:
+        return QString("pts %1 decode %2 ms").arg(record.a).arg(record.b / 1000.0, 0, 'f', 2);
+    case FlightEvent::FramePresented:
+        return QString("pts %1").arg(record.a);
+    case FlightEvent::FrameDropped:
+    case FlightEvent::AudioOverrun:
+        return QString("%1 so far").arg(record.a);
+    case FlightEvent::Crash:
+        return QString("signal %1 (%2)").arg(record.a).arg(QString::fromLocal8Bit(strsignal(static_cast<int>(record.a))));
+    case FlightEvent::LinkRtt:
+        return QString("%1 ms").arg(record.a / 1000.0, 0, 'f', 2);
+    case FlightEvent::LinkState: {
+        static const char *const states[] = {"healthy", "degraded", "dead"};
+        return QString("%1, %2 pings lost").arg(record.a < 3 ? states[record.a] : "unknown").arg(record.b);
+    }
+    case FlightEvent::Milestone:
+        return QString("%1 at %2 ms, %3 s after boot").arg(QString::fromUtf8(record.text)).arg(record.a)
+            .arg(record.b / 1000.0, 0, 'f', 2);
+    }
+    return QString("a %1 b %2").arg(record.a).arg(record.b);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // Same data directory as the head unit, so the default file is found
+    QCoreApplication::setOrganizationName("aa-qt");
+    QCoreApplication::setApplicationName("AndroidAutoQt");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Prints an AndroidAutoQt flight recorder file as a timeline.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file", "Recorder file, flight.rec in the application data directory by default.");
+    QCommandLineOption tailOption("tail", "Only the last <n> events.", "n");
+    QCommandLineOption eventsOption("events", "Only these comma-separated events, e.g. stall,error,frame-presented.", "names");
+    QCommandLineOption gapOption("gap-ms", "Mark gaps between events longer than <ms> (default 100).", "ms", "100");
+    parser.addOption(tailOption);
+    parser.addOption(eventsOption);
+    parser.addOption(gapOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QStringList positional = parser.positionalArguments();
+    const QString path = !positional.isEmpty()
+        ? positional.first()
+        : QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/flight.rec";
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        err << "Cannot open " << path << ": " << file.errorString() << Qt::endl;
+        return 1;
+    }
+    const QByteArray data = file.readAll();
+
+    FlightHeader header;
+    if (data.size() < static_cast<int>(sizeof(header))) {
+        err << path << " is too short for a flight recorder file" << Qt::endl;
+        return 1;
+    }
+    std::memcpy(&header, data.constData(), sizeof(header));
+    if (std::memcmp(header.magic, cFlightMagic, sizeof(header.magic)) != 0) {
+        err << path << " is not a flight recorder file" << Qt::endl;
+        return 1;
+    }
+    if (header.version != cFlightVersion || header.recordSize != sizeof(FlightRecord)) {
+        err << path << " has format version " << header.version << ", this tool reads " << cFlightVersion << Qt::endl;
+        return 1;
+    }
+    const uint64_t available = (data.size() - sizeof(header)) / sizeof(FlightRecord);
+    if (header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 || header.capacity > available) {
+        err << path << " is truncated" << Qt::endl;
+        return 1;
+    }
+
+    // Slots still being written, or overwritten mid-record, fail the index check
+    std::vector<FlightRecord> records;
+    records.reserve(header.capacity);
+    int torn = 0;
+    const char *slots = data.constData() + sizeof(header);
+    for (uint64_t i = 0; i < header.capacity; ++i) {
+        FlightRecord record;
+        std::memcpy(&record, slots + i * sizeof(FlightRecord), sizeof(record));
+        if (record.sequence == 0) {
+            continue;
+        }
+        if (((record.sequence - 1) & (header.capacity - 1)) != i) {
+            ++torn;
+            continue;
+        }
+        records.push_back(record);
+    }
+    std::sort(records.begin(), records.end(), [](const FlightRecord &left, const FlightRecord &right) {
+        return left.sequence < right.sequence;
+    });
+
+    // Frames are matched by timestamp before filtering, so latencies survive --events
+    QHash<uint64_t, int64_t> submitted;
+    QHash<uint64_t, int64_t> latencyNs;
+    for (const FlightRecord &record : records) {
+        if (record.event == static_cast<uint16_t>(FlightEvent::FrameSubmitted)) {
+            submitted.insert(record.a, record.timestampNs);
+        } else if (record.event == static_cast<uint16_t>(FlightEvent::FramePresented) && submitted.contains(record.a)) {
+            latencyNs.insert(record.sequence, record.timestampNs - submitted.take(record.a));
+        }
+    }
+
+    QSet<QString> events;
+    if (parser.isSet(eventsOption)) {
+        for (const QString &name : parser.value(eventsOption).split(',', Qt::SkipEmptyParts)) {
+            events.insert(name.trimmed());
+        }
+        records.erase(std::remove_if(records.begin(), records.end(), [&events](const FlightRecord &record) {
+            return !events.contains(QString::fromLatin1(flightEventName(record.event)));
+        }), records.end());
+    }
+    if (parser.isSet(tailOption)) {
+        const size_t tail = parser.value(tailOption).toUInt();
+        if (records.size() > tail) {
+            records.erase(records.begin(), records.end() - tail);
+        }
+    }
+
+    out << path << ": pid " << header.pid << ", " << records.size() << " events";
+    if (torn > 0) {
+        out << ", " << torn << " torn records skipped";
+    }
+    out << Qt::endl;
+
+    const int64_t gapNs = parser.value(gapOption).toLongLong() * 1000000;
+    QHash<uint64_t, int> stalls;
+    int64_t previousNs = records.empty() ? 0 : records.front().timestampNs;
+    for (const FlightRecord &record : records) {
+        const int64_t deltaNs = record.timestampNs - previousNs;
+        previousNs = record.timestampNs;
+        if (gapNs > 0 && deltaNs >= gapNs) {
+            out << QString("%1 ---- %2 ms without events ----").arg("", 26).arg(deltaNs / 1e6, 0, 'f', 1) << Qt::endl;
+        }
+
+        QString line = QString("%1 %2 %3 %4 %5")
+            .arg(wallClock(header, record.timestampNs))
+            .arg(QString("+%1").arg(deltaNs / 1e6, 0, 'f', 3), 10)
+            .arg(record.thread, 7)
+            .arg(QString::fromLatin1(flightEventName(record.event)), -16)
+            .arg(describe(record));
+        if (latencyNs.contains(record.sequence)) {
+            line += QString(" submit-to-present %1 ms").arg(latencyNs.value(record.sequence) / 1e6, 0, 'f', 1);
+        }
+        out << line << Qt::endl;
+
+        if (record.event == static_cast<uint16_t>(FlightEvent::Stall)) {
+            ++stalls[record.a];
+        }
+    }
+
+    for (auto it = stalls.constBegin(); it != stalls.constEnd(); ++it) {
+        out << "Stalls in " << flightStageName(it.key()) << ": " << it.value() << Qt::endl;
+    }
+    if (!records.empty() && records.back().event == static_cast<uint16_t>(FlightEvent::Crash)) {
+        out << "The process crashed: " << describe(records.back()) << Qt::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "loopbacktransport.h"
+
+#include <aasdk/Error/Error.hpp>
+
+LoopbackTransport::LoopbackTransport(boost::asio::io_service &ioService)
+    : m_ioService(ioService),
+      m_pendingSize(0),
+      m_disconnected(false)
+{
+}
+
+std::pair<LoopbackTransport::Pointer, LoopbackTransport::Pointer>
+LoopbackTransport::createPair(boost::asio::io_service &first, boost::asio::io_service &second)
+{
+    Pointer a(new LoopbackTransport(first));
+    Pointer b(new LoopbackTransport(second));
+    a->m_peer = b;
+    b->m_peer = a;
+    return std::make_pair(a, b);
+}
+
+void LoopbackTransport::start(aasdk::io::PromisePtr<void> promise)
+{
+    m_ioService.post([promise]() { promise->resolve(); });
+}
+
+void LoopbackTransport::stop(aasdk::io::PromisePtr<void> promise)
+{
+    disconnect();
+    if (auto peer = m_peer.lock()) {
+        peer->disconnect();
+    }
+    m_ioService.post([promise]() { promise->resolve(); });
+}
+
+void LoopbackTransport::receive(size_t size, aasdk::io::PromisePtr<aasdk::common::Data> promise)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_disconnected) {
+        m_ioService.post([promise]() {
+            promise->reject(aasdk::error::Error(aasdk::error::ErrorCode::OPERATION_ABORTED));
+        });
+        return;
+    }
+
+    m_pendingSize = size;
+    m_pendingPromise = std::move(promise);
+    servePending();
+}
+
+void LoopbackTransport::send(aasdk::common::Data data, aasdk::io::PromisePtr<void> promise)
+{
+    auto peer = m_peer.lock();
+
+    bool disconnected;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        disconnected = m_disconnected || peer == nullptr;
+    }
+
+    if (disconnected) {
+        m_ioService.post([promise]() {
+            promise->reject(aasdk::error::Error(aasdk::error::ErrorCode::OPERATION_ABORTED));
+        });
+        return;
+    }
+
+    peer->deliver(data);
+    m_ioService.post([promise]() { promise->resolve(); });
+}
+
+void LoopbackTransport::deliver(const aasdk::common::Data &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_disconnected) {
+        m_buffer.insert(m_buffer.end(), data.begin(), data.end());
+        servePending();
+    }
+}
+
+void LoopbackTransport::disconnect()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_disconnected) {
+        return;
+    }
+
+    m_disconnected = true;
+    m_buffer.clear();
+
+    if (m_pendingPromise != nullptr) {
+        auto promise = std::move(m_pendingPromise);
+        m_pendingPromise.reset();
+        m_ioService.post([promise]() {
+            promise->reject(aasdk::error::Error(aasdk::error::ErrorCode::OPERATION_ABORTED));
+        });
+    }
+}
+
+void LoopbackTransport::servePending()
+{
+    if (m_pendingPromise == nullptr || m_buffer.size() < m_pendingSize) {
+        return;
+    }
+
+    auto data = std::make_shared<aasdk::common::Data>(m_buffer.begin(), m_buffer.begin() + m_pendingSize);
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_pendingSize);
+
+    auto promise = std::move(m_pendingPromise);
+    m_pendingPromise.reset();
+    m_ioService.post([promise, data]() { promise->resolve(std::move(*data)); });
+}
@@ -0,0 +1,48 @@
+#ifndef LOOPBACKTRANSPORT_H
+#define LOOPBACKTRANSPORT_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <boost/asio.hpp>
+
+#include <aasdk/Transport/ITransport.hpp>
+#include <aasdk/IO/Promise.hpp>
+
+// In-memory stand-in for the USB link. Two ends are created together; bytes
+// sent on one are received on the other, and each end completes its promises
+// on its own io_service so either side can run on its own thread. Stopping
+// either end disconnects both, the way unplugging the cable does.
+class LoopbackTransport : public aasdk::transport::ITransport,
+                          public std::enable_shared_from_this<LoopbackTransport>
+{
+public:
+    typedef std::shared_ptr<LoopbackTransport> Pointer;
+
+    static std::pair<Pointer, Pointer> createPair(boost::asio::io_service &first, boost::asio::io_service &second);
+
+    void start(aasdk::io::PromisePtr<void> promise) override;
+    void stop(aasdk::io::PromisePtr<void> promise) override;
+    void receive(size_t size, aasdk::io::PromisePtr<aasdk::common::Data> promise) override;
+    void send(aasdk::common::Data data, aasdk::io::PromisePtr<void> promise) override;
+
+private:
+    explicit LoopbackTransport(boost::asio::io_service &ioService);
+
+    void deliver(const aasdk::common::Data &data);
+    void disconnect();
+    // Called with m_mutex held
+    void servePending();
+
+    boost::asio::io_service &m_ioService;
+    std::weak_ptr<LoopbackTransport> m_peer;
+
+    std::mutex m_mutex;
+    std::deque<uint8_t> m_buffer;
+    size_t m_pendingSize;
+    aasdk::io::PromisePtr<aasdk::common::Data> m_pendingPromise;
+    bool m_disconnected;
+};
+
+#endif // LOOPBACKTRANSPORT_H
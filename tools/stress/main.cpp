@@ -0,0 +1,308 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QTextStream>
+#include <QTimer>
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "androidauto.h"
+#include "h264pattern.h"
+#include "loopbacktransport.h"
+#include "phoneemulator.h"
+#include "processresources.h"
+
+// Connect/disconnect soak for the head unit. Every cycle attaches a fresh
+// emulated phone over an in-memory transport, waits for the first decoded
+// frame, disconnects and waits for the session to drain. Resource usage is
+// sampled after every cycle and compared between the start and the end of
+// the run, so slow leaks fail the run instead of a unit in the field.
+
+namespace {
+
+struct CycleResult
+{
+    double firstFrameMs = -1;
+    double idleMs = 0;
+    ProcessResources resources;
+};
+
+double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    return values[index];
+}
+
+template<typename Getter>
+double windowMedian(const std::vector<CycleResult> &results, size_t begin, size_t end, Getter getter)
+{
+    std::vector<double> values;
+    for (size_t i = begin; i < end; ++i) {
+        values.push_back(getter(results[i].resources));
+    }
+    return percentile(values, 0.5);
+}
+
+bool verbose = false;
+
+void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    // Per-cycle session logging drowns the results
+    if (type == QtDebugMsg && !verbose) {
+        return;
+    }
+    QTextStream(stderr) << qFormatLogMessage(type, context, message) << Qt::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    // No display is needed; frames are only counted
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QGuiApplication app(argc, argv);
+    // Same settings file as the head unit, so decoder and session tuning apply
+    QCoreApplication::setOrganizationName("aa-qt");
+    QCoreApplication::setApplicationName("AndroidAutoQt");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Connect/disconnect soak test for AndroidAutoQt sessions");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"cycles", "Connect/disconnect cycles to run.", "count", "2000"},
+        {"warmup", "Cycles excluded from the leak baseline.", "count", "50"},
+        {"window", "Cycles averaged for the baseline and final resource usage.", "count", "50"},
+        {"hold-ms", "How long to keep streaming after the first frame.", "ms", "200"},
+        {"first-frame-timeout-ms", "Give up on a cycle without a frame after this long.", "ms", "5000"},
+        {"width", "Video width.", "pixels", "640"},
+        {"height", "Video height.", "pixels", "360"},
+        {"fps", "Video frame rate.", "fps", "30"},
+        {"rss-slack-kb", "Allowed RSS growth between baseline and end.", "kb", "4096"},
+        {"fd-slack", "Allowed file descriptor growth.", "count", "0"},
+        {"thread-slack", "Allowed thread count growth.", "count", "0"},
+        {"usb", "Also run the USB hub setup and teardown every cycle."},
+        {"csv", "Write per-cycle results to this file.", "path"},
+        {"verbose", "Show session debug logging."},
+    });
+    parser.process(app);
+
+    verbose = parser.isSet("verbose");
+    qInstallMessageHandler(messageHandler);
+
+    const int cycles = parser.value("cycles").toInt();
+    const int warmup = parser.value("warmup").toInt();
+    const int window = parser.value("window").toInt();
+    const int holdMs = parser.value("hold-ms").toInt();
+    const int firstFrameTimeoutMs = parser.value("first-frame-timeout-ms").toInt();
+    const bool usb = parser.isSet("usb");
+
+    if (cycles < warmup + 2 * window) {
+        qCritical() << "Need at least warmup + 2 * window cycles";
+        return 2;
+    }
+
+    QTextStream out(stdout);
+
+    H264Pattern::Config patternConfig;
+    patternConfig.width = parser.value("width").toInt();
+    patternConfig.height = parser.value("height").toInt();
+    patternConfig.fps = parser.value("fps").toInt();
+    patternConfig.bitrate = 2000000;
+    patternConfig.seconds = 1;
+
+    H264Pattern pattern;
+    if (!pattern.generate(patternConfig)) {
+        qCritical() << "Unable to generate the video pattern:" << pattern.errorString();
+        return 2;
+    }
+
+    PhoneEmulator::Config emulatorConfig;
+    emulatorConfig.videoFps = patternConfig.fps;
+    emulatorConfig.audioPacketsPerSecond = 0;
+    emulatorConfig.pingsPerSecond = 10;
+
+    // The phone side runs on its own io thread, like a real phone would
+    boost::asio::io_service phoneIoService;
+    auto phoneWork = std::make_shared<boost::asio::io_service::work>(phoneIoService);
+    std::thread phoneThread([&phoneIoService]() { phoneIoService.run(); });
+
+    auto androidAuto = std::make_shared<AndroidAuto>();
+
+    std::vector<CycleResult> results;
+    results.reserve(cycles);
+    int firstFrameTimeouts = 0;
+    // Nothing is measured if no frame ever arrives; stop instead of timing out every cycle
+    const int cNoFrameCycles = 3;
+    bool neverStreamed = false;
+
+    for (int cycle = 0; cycle < cycles; ++cycle) {
+        CycleResult result;
+        QElapsedTimer timer;
+        timer.start();
+
+        if (usb) {
+            androidAuto->onDeviceConnected("stress");
+        }
+
+        auto link = LoopbackTransport::createPair(androidAuto->ioService(), phoneIoService);
+        auto emulator = std::make_shared<PhoneEmulator>(phoneIoService, emulatorConfig, pattern);
+        phoneIoService.post([emulator, transport = link.second]() { emulator->startSession(transport); });
+
+        QEventLoop loop;
+        bool gotFrame = false;
+        QObject::connect(androidAuto.get(), &AndroidAuto::firstFramePresented, &loop, [&]() {
+            gotFrame = true;
+            loop.quit();
+        });
+        QTimer::singleShot(firstFrameTimeoutMs, &loop, &QEventLoop::quit);
+
+        androidAuto->attachTransport(link.first);
+        loop.exec();
+
+        if (gotFrame) {
+            result.firstFrameMs = timer.nsecsElapsed() / 1e6;
+        } else {
+            ++firstFrameTimeouts;
+            qWarning() << "Cycle" << cycle << "produced no frame within" << firstFrameTimeoutMs << "ms";
+        }
+        neverStreamed = firstFrameTimeouts == cycle + 1 && firstFrameTimeouts >= cNoFrameCycles;
+
+        if (holdMs > 0) {
+            QEventLoop hold;
+            QTimer::singleShot(holdMs, &hold, &QEventLoop::quit);
+            hold.exec();
+        }
+
+        // Teardown blocks until the session has drained
+        timer.restart();
+        androidAuto->onDeviceDisconnected("stress");
+
+        auto emulatorStopped = std::make_shared<std::promise<void>>();
+        phoneIoService.post([emulator, emulatorStopped]() {
+            emulator->stop();
+            emulatorStopped->set_value();
+        });
+        emulatorStopped->get_future().wait();
+        result.idleMs = timer.nsecsElapsed() / 1e6;
+
+        // Frames still queued for the GUI thread belong to this cycle
+        QCoreApplication::processEvents();
+
+        result.resources = ProcessResources::sample();
+        results.push_back(result);
+
+        if (neverStreamed) {
+            break;
+        }
+
+        if ((cycle + 1) % 100 == 0) {
+            out << QString("cycle %1: first frame %2 ms, idle %3 ms, rss %4 kB, fds %5, threads %6")
+                       .arg(cycle + 1)
+                       .arg(result.firstFrameMs, 0, 'f', 1)
+                       .arg(result.idleMs, 0, 'f', 1)
+                       .arg(result.resources.rssKb)
+                       .arg(result.resources.fdCount)
+                       .arg(result.resources.threadCount)
+                << Qt::endl;
+        }
+    }
+
+    const quint64 stalledTeardowns = androidAuto->stalledTeardowns();
+    androidAuto.reset();
+    phoneWork.reset();
+    phoneThread.join();
+
+    if (neverStreamed) {
+        out << "FAIL: none of the first " << cNoFrameCycles << " cycles produced a frame; the emulator is not streaming" << Qt::endl;
+        return 1;
+    }
+
+    if (parser.isSet("csv")) {
+        QFile file(parser.value("csv"));
+        if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            QTextStream csv(&file);
+            csv << "cycle,first_frame_ms,idle_ms,rss_kb,fds,threads\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const CycleResult &r = results[i];
+                csv << i << ',' << r.firstFrameMs << ',' << r.idleMs << ',' << r.resources.rssKb << ','
+                    << r.resources.fdCount << ',' << r.resources.threadCount << '\n';
+            }
+        } else {
+            qWarning() << "Unable to write" << file.fileName();
+        }
+    }
+
+    std::vector<double> firstFrame;
+    std::vector<double> idle;
+    for (const CycleResult &r : results) {
+        if (r.firstFrameMs >= 0) {
+            firstFrame.push_back(r.firstFrameMs);
+        }
+        idle.push_back(r.idleMs);
+    }
+
+    if (firstFrame.empty()) {
+        out << "time to first frame: no cycle produced a frame" << Qt::endl;
+    } else {
+        out << QString("time to first frame: p50 %1 ms, p95 %2 ms, max %3 ms over %4 cycles")
+                   .arg(percentile(firstFrame, 0.5), 0, 'f', 1)
+                   .arg(percentile(firstFrame, 0.95), 0, 'f', 1)
+                   .arg(percentile(firstFrame, 1.0), 0, 'f', 1)
+                   .arg(firstFrame.size()) << Qt::endl;
+    }
+    out << QString("time to idle: p50 %1 ms, p95 %2 ms, max %3 ms")
+               .arg(percentile(idle, 0.5), 0, 'f', 1)
+               .arg(percentile(idle, 0.95), 0, 'f', 1)
+               .arg(percentile(idle, 1.0), 0, 'f', 1) << Qt::endl;
+
+    // Medians over a window at each end, so one noisy sample cannot fail or pass the run
+    const size_t baselineEnd = warmup + window;
+    const size_t finalBegin = results.size() - window;
+    const double rssBefore = windowMedian(results, warmup, baselineEnd, [](const ProcessResources &r) { return r.rssKb; });
+    const double rssAfter = windowMedian(results, finalBegin, results.size(), [](const ProcessResources &r) { return r.rssKb; });
+    const double fdsBefore = windowMedian(results, warmup, baselineEnd, [](const ProcessResources &r) { return r.fdCount; });
+    const double fdsAfter = windowMedian(results, finalBegin, results.size(), [](const ProcessResources &r) { return r.fdCount; });
+    const double threadsBefore = windowMedian(results, warmup, baselineEnd, [](const ProcessResources &r) { return r.threadCount; });
+    const double threadsAfter = windowMedian(results, finalBegin, results.size(), [](const ProcessResources &r) { return r.threadCount; });
+
+    out << QString("rss %1 -> %2 kB, fds %3 -> %4, threads %5 -> %6")
+               .arg(rssBefore).arg(rssAfter).arg(fdsBefore).arg(fdsAfter).arg(threadsBefore).arg(threadsAfter) << Qt::endl;
+
+    QStringList failures;
+    if (rssAfter - rssBefore > parser.value("rss-slack-kb").toDouble()) {
+        failures << QString("RSS grew by %1 kB").arg(rssAfter - rssBefore);
+    }
+    if (fdsAfter - fdsBefore > parser.value("fd-slack").toDouble()) {
+        failures << QString("file descriptors grew by %1").arg(fdsAfter - fdsBefore);
+    }
+    if (threadsAfter - threadsBefore > parser.value("thread-slack").toDouble()) {
+        failures << QString("threads grew by %1").arg(threadsAfter - threadsBefore);
+    }
+    if (firstFrameTimeouts > 0) {
+        failures << QString("%1 cycles produced no frame").arg(firstFrameTimeouts);
+    }
+    if (stalledTeardowns > 0) {
+        failures << QString("%1 teardowns did not drain in time").arg(stalledTeardowns);
+    }
+
+    if (!failures.isEmpty()) {
+        out << "FAIL: " << failures.join("; ") << Qt::endl;
+        return 1;
+    }
+
+    out << "PASS: " << cycles << " cycles" << Qt::endl;
+    return 0;
+}
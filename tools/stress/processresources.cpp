@@ -0,0 +1,25 @@
+#include "processresources.h"
+
+#include <QDir>
+#include <QFile>
+
+ProcessResources ProcessResources::sample()
+{
+    ProcessResources resources;
+
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        for (const QByteArray &line : status.readAll().split('\n')) {
+            if (line.startsWith("VmRSS:")) {
+                resources.rssKb = line.mid(6).trimmed().split(' ').value(0).toLongLong();
+            } else if (line.startsWith("Threads:")) {
+                resources.threadCount = line.mid(8).trimmed().toInt();
+            }
+        }
+    }
+
+    // The listing itself holds one descriptor open while it runs
+    resources.fdCount = QDir("/proc/self/fd").entryList(QDir::Files | QDir::System | QDir::NoDotAndDotDot).size() - 1;
+
+    return resources;
+}
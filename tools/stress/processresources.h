@@ -0,0 +1,16 @@
+#ifndef PROCESSRESOURCES_H
+#define PROCESSRESOURCES_H
+
+#include <QtGlobal>
+
+// Point-in-time resource usage of this process, read from /proc
+struct ProcessResources
+{
+    qint64 rssKb = 0;
+    int fdCount = 0;
+    int threadCount = 0;
+
+    static ProcessResources sample();
+};
+
+#endif // PROCESSRESOURCES_H